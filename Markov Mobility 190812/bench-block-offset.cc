@@ -0,0 +1,169 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Compare the block offset loop Intersections::CalPercent used to run
+// with the closed form in RoadGrid::GetBlock. GetBlock is first checked
+// on the block edges, one ulp on either side of them and on negative
+// coordinates; the program fails if it splits one of them wrong.
+//
+// ./waf --run "bench-block-offset --intersection=100 --distance=500"
+
+#include "road-grid.h"
+#include "ns3/command-line.h"
+#include "ns3/random-variable-stream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * The offset loop Intersections::CalPercent used before RoadGrid::GetBlock.
+ */
+static double
+LoopOffset (double a, double b)
+{
+  double c = a;
+  for(;c >= 0;c-=b){}
+  c += b;
+  return c;
+}
+
+/**
+ * \brief Check the split of one coordinate
+ * \param grid the lattice
+ * \param a the coordinate
+ * \return false, after printing why, if the block and offset GetBlock
+ *         gives do not add up to a or the offset is out of [0, Distance)
+ */
+static bool
+CheckBlock (Ptr<RoadGrid> grid, double a)
+{
+  double distance = grid->GetDistance ();
+  double offset;
+  int64_t block = grid->GetBlock (a, offset);
+  // a few ulps of rounding, and a coordinate on an edge may fall on either side
+  double ulps = 4 * std::ldexp (1.0, std::ilogb (std::fabs (a) + distance) - 52);
+  long double sum = (long double) block * distance + offset;
+  bool ok = offset >= 0 && offset < distance && std::fabs ((double) (sum - a)) <= ulps;
+  if (ok && a >= 0 && a < distance * 64)
+    {
+      double diff = std::fabs (offset - LoopOffset (a, distance));
+      ok = std::min (diff, distance - diff) <= 16 * ulps;
+    }
+  if (!ok)
+    {
+      std::cerr << "GetBlock (" << a << ") = " << block << ", offset " << offset
+                << ": wrong split" << std::endl;
+    }
+  return ok;
+}
+
+/**
+ * \brief Check GetBlock around the block edges and below 0
+ * \param grid the lattice
+ * \return the number of wrong splits
+ */
+static uint32_t
+CheckBlocks (Ptr<RoadGrid> grid)
+{
+  double distance = grid->GetDistance ();
+  int64_t intersection = grid->GetIntersection ();
+  uint32_t wrong = 0;
+  for (int64_t k = -intersection; k <= intersection; k++)
+    {
+      double edge = k * distance;
+      wrong += !CheckBlock (grid, edge);
+      wrong += !CheckBlock (grid, std::nextafter (edge, -HUGE_VAL));
+      wrong += !CheckBlock (grid, std::nextafter (edge, HUGE_VAL));
+      wrong += !CheckBlock (grid, edge + distance / 2);
+    }
+  wrong += !CheckBlock (grid, -0.0);
+  wrong += !CheckBlock (grid, -1e-300);
+  return wrong;
+}
+
+/**
+ * \param start when the measure started
+ * \param n the number of operations measured
+ * \return the time per operation in nanoseconds
+ */
+static double
+NsPerOp (std::chrono::steady_clock::time_point start, uint32_t n)
+{
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now () - start;
+  return elapsed.count () / n;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t intersection = 100;
+  double distance = 500;
+  uint32_t n = 1000000;
+
+  CommandLine cmd;
+  cmd.AddValue ("intersection", "number of intersections on each axis", intersection);
+  cmd.AddValue ("distance", "distance between intersections", distance);
+  cmd.AddValue ("n", "number of coordinates to split", n);
+  cmd.Parse (argc, argv);
+
+  Ptr<RoadGrid> grid = CreateObject<RoadGrid> ();
+  grid->SetIntersection (intersection);
+  grid->SetDistance (distance);
+
+  uint32_t wrong = CheckBlocks (grid);
+  if (wrong != 0)
+    {
+      std::cerr << wrong << " coordinates split wrong by GetBlock" << std::endl;
+      return 1;
+    }
+
+  Ptr<UniformRandomVariable> rv = CreateObject<UniformRandomVariable> ();
+  std::vector<double> coordinates (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      coordinates[i] = rv->GetValue (0, distance * intersection);
+    }
+
+  double loopSum = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  for (uint32_t i = 0; i < n; i++)
+    {
+      loopSum += LoopOffset (coordinates[i], distance);
+    }
+  double loopNs = NsPerOp (start, n);
+
+  double blockSum = 0;
+  int64_t blocks = 0;
+  start = std::chrono::steady_clock::now ();
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double offset;
+      blocks += grid->GetBlock (coordinates[i], offset);
+      blockSum += offset;
+    }
+  double blockNs = NsPerOp (start, n);
+
+  std::cout << "map " << intersection * distance / 1000 << " km, "
+            << n << " coordinates" << std::endl
+            << "loop:        " << loopNs << " ns/op (sum " << loopSum << ")" << std::endl
+            << "closed form: " << blockNs << " ns/op (sum " << blockSum
+            << ", blocks " << blocks << ")" << std::endl
+            << "speedup:     " << loopNs / blockNs << std::endl;
+  return 0;
+}
@@ -0,0 +1,389 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Install IntersectionsPosition and Intersections on nodes without a
+// network stack, run them, and measure how the run scales with the
+// number of vehicles: scheduler events, wall time, events per second and
+// peak resident memory, written as JSON. Each vehicle count runs in a
+// child process of its own, so that its peak memory is its own.
+//
+// ./waf --run "bench-intersections-scale --vehicles=1000,10000,100000,1000000 --time=60 --output=scale.json"
+//
+// With --baseline the results are compared with those of an earlier
+// output; the program fails if events per second dropped or peak memory
+// grew by more than --tolerance.
+//
+// ./waf --run "bench-intersections-scale --vehicles=1000,10000 --baseline=scale.json"
+//
+// With --helper the vehicles are installed by IntersectionsHelper, drawing
+// their start state on --threads threads, and setupSeconds compares its
+// install time with that of MobilityHelper.
+//
+// ./waf --run "bench-intersections-scale --vehicles=100000 --time=0 --helper=1 --threads=1"
+
+#include "road-grid.h"
+#include "intersections-helper.h"
+#include "ns3/command-line.h"
+#include "ns3/mobility-helper.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/pointer.h"
+#include "ns3/string.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+/** The scenario every vehicle count is run on. */
+struct Scenario
+{
+  uint32_t grid;          //!< lanes each way
+  uint32_t intersection;  //!< intersections on each axis
+  double distance;        //!< distance between intersections
+  double time;            //!< simulated seconds
+  double speed;           //!< speed in m/s
+  double deltaSpeed;      //!< bound of the speed offset in m/s
+  bool eventDriven;       //!< EventDriven attribute of Intersections
+  bool helper;            //!< install with IntersectionsHelper rather than MobilityHelper
+  uint32_t threads;       //!< threads of IntersectionsHelper, 0 for all
+};
+
+/** What the run of one vehicle count measured. */
+struct Result
+{
+  uint32_t vehicles;      //!< number of vehicles
+  uint64_t events;        //!< scheduler events processed
+  double setup;           //!< wall seconds to create and install the nodes
+  double wall;            //!< wall seconds of the simulation
+  double eventsPerSecond; //!< events per wall second of the simulation
+  long peakRss;           //!< peak resident memory in KiB
+};
+
+/**
+ * Install and run one vehicle count, in the calling process.
+ * \param scenario the scenario
+ * \param vehicles the number of vehicles
+ * \return the measures
+ */
+static Result
+Run (const Scenario &scenario, uint32_t vehicles)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+  Ptr<RoadGrid> road = CreateObject<RoadGrid> ();
+  road->SetGrid (scenario.grid);
+  road->SetIntersection (scenario.intersection);
+  road->SetDistance (scenario.distance);
+
+  NodeContainer nodes;
+  nodes.Create (vehicles);
+  std::ostringstream speed;
+  speed << "ns3::ConstantRandomVariable[Constant=" << scenario.speed << "]";
+  if (scenario.helper)
+    {
+      Ptr<IntersectionsPosition> position = CreateObject<IntersectionsPosition> ();
+      position->SetAttribute ("Num", UintegerValue (vehicles));
+      position->SetAttribute ("RoadGrid", PointerValue (road));
+      IntersectionsHelper intersections;
+      intersections.SetPositionAllocator (position);
+      intersections.SetAttribute ("RoadGrid", PointerValue (road));
+      intersections.SetAttribute ("Speed", StringValue (speed.str ()));
+      intersections.SetAttribute ("DeltaSpeed", DoubleValue (scenario.deltaSpeed));
+      intersections.SetAttribute ("EventDriven", BooleanValue (scenario.eventDriven));
+      intersections.SetThreads (scenario.threads);
+      intersections.Install (nodes);
+    }
+  else
+    {
+      MobilityHelper mobility;
+      mobility.SetPositionAllocator ("ns3::IntersectionsPosition",
+                                     "Num", UintegerValue (vehicles),
+                                     "RoadGrid", PointerValue (road));
+      mobility.SetMobilityModel ("ns3::Intersections",
+                                 "RoadGrid", PointerValue (road),
+                                 "Speed", StringValue (speed.str ()),
+                                 "DeltaSpeed", DoubleValue (scenario.deltaSpeed),
+                                 "EventDriven", BooleanValue (scenario.eventDriven));
+      mobility.Install (nodes);
+    }
+
+  std::chrono::steady_clock::time_point run = std::chrono::steady_clock::now ();
+  Simulator::Stop (Seconds (scenario.time));
+  Simulator::Run ();
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now ();
+
+  Result r;
+  r.vehicles = vehicles;
+  r.events = Simulator::GetEventCount ();
+  r.setup = std::chrono::duration<double> (run - start).count ();
+  r.wall = std::chrono::duration<double> (end - run).count ();
+  r.eventsPerSecond = r.events / r.wall;
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  r.peakRss = usage.ru_maxrss;
+  Simulator::Destroy ();
+  return r;
+}
+
+/**
+ * Run one vehicle count in a child process.
+ * \param scenario the scenario
+ * \param vehicles the number of vehicles
+ * \param result set to the measures
+ * \return false if the child failed
+ */
+static bool
+RunChild (const Scenario &scenario, uint32_t vehicles, Result &result)
+{
+  int fd[2];
+  if (pipe (fd) != 0)
+    {
+      return false;
+    }
+  pid_t pid = fork ();
+  if (pid < 0)
+    {
+      close (fd[0]);
+      close (fd[1]);
+      return false;
+    }
+  if (pid == 0)
+    {
+      close (fd[0]);
+      Result r = Run (scenario, vehicles);
+      bool written = write (fd[1], &r, sizeof (r)) == sizeof (r);
+      close (fd[1]);
+      _exit (written ? 0 : 1);
+    }
+  close (fd[1]);
+  bool received = read (fd[0], &result, sizeof (result)) == sizeof (result);
+  close (fd[0]);
+  int status;
+  waitpid (pid, &status, 0);
+  return received && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+/**
+ * \param out the stream to write to
+ * \param scenario the scenario
+ * \param results the measures of each vehicle count
+ */
+static void
+WriteJson (std::ostream &out, const Scenario &scenario, const std::vector<Result> &results)
+{
+  out << "{" << std::endl
+      << "  \"grid\": " << scenario.grid << "," << std::endl
+      << "  \"intersection\": " << scenario.intersection << "," << std::endl
+      << "  \"distance\": " << scenario.distance << "," << std::endl
+      << "  \"time\": " << scenario.time << "," << std::endl
+      << "  \"speed\": " << scenario.speed << "," << std::endl
+      << "  \"deltaSpeed\": " << scenario.deltaSpeed << "," << std::endl
+      << "  \"eventDriven\": " << (scenario.eventDriven ? "true" : "false") << "," << std::endl
+      << "  \"helper\": " << (scenario.helper ? "true" : "false") << "," << std::endl
+      << "  \"threads\": " << scenario.threads << "," << std::endl
+      << "  \"runs\": [" << std::endl;
+  for (uint32_t i = 0; i < results.size (); i++)
+    {
+      const Result &r = results[i];
+      out << "    { \"vehicles\": " << r.vehicles
+          << ", \"events\": " << r.events
+          << ", \"setupSeconds\": " << r.setup
+          << ", \"wallSeconds\": " << r.wall
+          << ", \"eventsPerSecond\": " << r.eventsPerSecond
+          << ", \"peakRssKiB\": " << r.peakRss
+          << " }" << (i + 1 < results.size () ? "," : "") << std::endl;
+    }
+  out << "  ]" << std::endl
+      << "}" << std::endl;
+}
+
+/**
+ * Find a number in the JSON this program writes.
+ * \param text the JSON text
+ * \param begin where to start looking
+ * \param end where to stop looking
+ * \param key the key of the number
+ * \param value set to the number
+ * \return false if the key is not between begin and end
+ */
+static bool
+FindNumber (const std::string &text, size_t begin, size_t end, const std::string &key, double &value)
+{
+  size_t at = text.find ("\"" + key + "\":", begin);
+  if (at == std::string::npos || at >= end)
+    {
+      return false;
+    }
+  at += key.size () + 3;
+  std::string rest = text.substr (at, end - at);
+  if (rest.find ("true") == 1 || rest.find ("false") == 1)
+    {
+      value = rest.find ("true") == 1;
+      return true;
+    }
+  value = std::strtod (rest.c_str (), 0);
+  return true;
+}
+
+/**
+ * \brief Compare the measures with those of a baseline output
+ * \param filename the baseline file
+ * \param scenario the scenario
+ * \param results the measures of each vehicle count
+ * \param tolerance the relative change accepted
+ * \return false if a vehicle count got slower or bigger beyond the tolerance
+ */
+static bool
+Compare (const std::string &filename, const Scenario &scenario,
+         const std::vector<Result> &results, double tolerance)
+{
+  std::ifstream in (filename.c_str ());
+  if (!in)
+    {
+      std::cerr << "cannot read baseline " << filename << std::endl;
+      return false;
+    }
+  std::stringstream buffer;
+  buffer << in.rdbuf ();
+  std::string text = buffer.str ();
+
+  size_t runs = text.find ("\"runs\"");
+  if (runs == std::string::npos)
+    {
+      std::cerr << filename << " is not an output of this benchmark" << std::endl;
+      return false;
+    }
+  double grid, intersection, distance, time, eventDriven;
+  if (!FindNumber (text, 0, runs, "grid", grid)
+      || !FindNumber (text, 0, runs, "intersection", intersection)
+      || !FindNumber (text, 0, runs, "distance", distance)
+      || !FindNumber (text, 0, runs, "time", time)
+      || !FindNumber (text, 0, runs, "eventDriven", eventDriven)
+      || grid != scenario.grid || intersection != scenario.intersection
+      || distance != scenario.distance || time != scenario.time
+      || eventDriven != scenario.eventDriven)
+    {
+      std::cerr << "warning: the baseline ran another scenario" << std::endl;
+    }
+
+  bool ok = true;
+  for (uint32_t i = 0; i < results.size (); i++)
+    {
+      const Result &r = results[i];
+      bool found = false;
+      size_t begin = runs;
+      while (!found && (begin = text.find ('{', begin)) != std::string::npos)
+        {
+          size_t end = text.find ('}', begin);
+          double vehicles, eventsPerSecond, peakRss;
+          if (FindNumber (text, begin, end, "vehicles", vehicles) && vehicles == r.vehicles
+              && FindNumber (text, begin, end, "eventsPerSecond", eventsPerSecond)
+              && FindNumber (text, begin, end, "peakRssKiB", peakRss))
+            {
+              found = true;
+              bool slower = r.eventsPerSecond < eventsPerSecond * (1 - tolerance);
+              bool bigger = r.peakRss > peakRss * (1 + tolerance);
+              std::cerr << r.vehicles << " vehicles: events/s " << eventsPerSecond
+                        << " -> " << r.eventsPerSecond << (slower ? " SLOWER" : "")
+                        << ", peak RSS " << peakRss << " -> " << r.peakRss << " KiB"
+                        << (bigger ? " BIGGER" : "") << std::endl;
+              ok = ok && !slower && !bigger;
+            }
+          begin = end;
+        }
+      if (!found)
+        {
+          std::cerr << r.vehicles << " vehicles: not in the baseline" << std::endl;
+        }
+    }
+  return ok;
+}
+
+int main (int argc, char *argv[])
+{
+  Scenario scenario;
+  scenario.grid = 2;
+  scenario.intersection = 10;
+  scenario.distance = 1000;
+  scenario.time = 60;
+  scenario.speed = 16.667;
+  scenario.deltaSpeed = 5.556;
+  scenario.eventDriven = false;
+  scenario.helper = false;
+  scenario.threads = 0;
+  std::string vehicles = "1000,10000,100000,1000000";
+  std::string output;
+  std::string baseline;
+  double tolerance = 0.1;
+
+  CommandLine cmd;
+  cmd.AddValue ("vehicles", "comma-separated vehicle counts", vehicles);
+  cmd.AddValue ("time", "simulated time in seconds", scenario.time);
+  cmd.AddValue ("grid", "number of lanes each way", scenario.grid);
+  cmd.AddValue ("intersection", "number of intersections on each axis", scenario.intersection);
+  cmd.AddValue ("distance", "distance between intersections", scenario.distance);
+  cmd.AddValue ("speed", "speed in m/s", scenario.speed);
+  cmd.AddValue ("deltaSpeed", "bound of the speed offset of each vehicle in m/s", scenario.deltaSpeed);
+  cmd.AddValue ("eventDriven", "run Intersections in its EventDriven mode", scenario.eventDriven);
+  cmd.AddValue ("helper", "install with IntersectionsHelper", scenario.helper);
+  cmd.AddValue ("threads", "threads of IntersectionsHelper, 0 for all", scenario.threads);
+  cmd.AddValue ("output", "JSON file to write, standard output if empty", output);
+  cmd.AddValue ("baseline", "JSON output of an earlier run to compare with", baseline);
+  cmd.AddValue ("tolerance", "relative change accepted by the comparison", tolerance);
+  cmd.Parse (argc, argv);
+
+  std::vector<Result> results;
+  std::istringstream counts (vehicles);
+  std::string count;
+  while (std::getline (counts, count, ','))
+    {
+      Result r;
+      if (!RunChild (scenario, std::strtoul (count.c_str (), 0, 10), r))
+        {
+          std::cerr << "the run of " << count << " vehicles failed" << std::endl;
+          return 1;
+        }
+      std::cerr << r.vehicles << " vehicles: installed in " << r.setup << " s, "
+                << r.events << " events in "
+                << r.wall << " s, " << r.eventsPerSecond << " events/s, "
+                << r.peakRss << " KiB" << std::endl;
+      results.push_back (r);
+    }
+
+  // compare first: the baseline may be the output file
+  bool ok = baseline.empty () || Compare (baseline, scenario, results, tolerance);
+  if (output.empty ())
+    {
+      WriteJson (std::cout, scenario, results);
+    }
+  else
+    {
+      std::ofstream out (output.c_str ());
+      WriteJson (out, scenario, results);
+    }
+  return ok ? 0 : 1;
+}
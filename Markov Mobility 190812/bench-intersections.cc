@@ -0,0 +1,473 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Time the steps of the Intersections walk one at a time, on vehicles
+// caught in the middle of a run, and count the heap allocations each
+// of them makes.
+//
+// ./waf --run "bench-intersections --vehicles=1000 --grid=2 --intersection=10 --distance=1000"
+
+#include "intersections.h"
+#include "position-allocator.h"
+#include "ns3/command-line.h"
+#include "ns3/simulator.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/pointer.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+// every operator new of the process, counted
+static uint64_t g_allocations = 0;
+
+void *
+operator new (std::size_t size)
+{
+  g_allocations++;
+  void *p = std::malloc (size != 0 ? size : 1);
+  if (p == 0)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+namespace ns3 {
+
+/**
+ * Calls the private steps of Intersections on a set of vehicles.
+ */
+class IntersectionsBench
+{
+public:
+  /**
+   * \param models the vehicles, initialized and on the move
+   */
+  IntersectionsBench (const std::vector<Ptr<Intersections> > &models);
+
+  /** \param rounds the number of passes over the vehicles */
+  void CalPercent (uint32_t rounds);
+  /** \param rounds the number of passes over the vehicles */
+  void GetStep (uint32_t rounds);
+  /** \param rounds the number of passes over the vehicles */
+  void ChangeVelocity (uint32_t rounds);
+  /** \param rounds the number of passes over the vehicles */
+  void ChangeRn (uint32_t rounds);
+  /** \param rounds the number of passes over the vehicles */
+  void GetPositionCold (uint32_t rounds);
+  /** \param rounds the number of passes over the vehicles */
+  void GetPositionCached (uint32_t rounds);
+  /** \param rounds the number of passes over the vehicles */
+  void ChangedDirection (uint32_t rounds);
+
+private:
+  /** The arguments of a turn or lane change step of a vehicle. */
+  struct Step
+  {
+    uint32_t vehicle; //!< index of the vehicle
+    double offset;    //!< offset along the road before the step
+    double next;      //!< offset one walk step later
+  };
+  /**
+   * Walk a vehicle forward from where the bench found it to the first
+   * step a turn or a lane change would be scheduled on.
+   * \param i the index of the vehicle
+   * \param turn true for a turn, false for a lane change
+   * \param steps the steps found so far, added to
+   */
+  void FindStep (uint32_t i, bool turn, std::vector<Step> &steps);
+  /** Take the pending walk step of every vehicle off the scheduler. */
+  void RemoveEvents (void);
+  /**
+   * Put a vehicle back on the road it was on when the bench started.
+   * \param i the index of the vehicle
+   */
+  void Restore (uint32_t i);
+
+  std::vector<Ptr<Intersections> > m_models; //!< the vehicles
+  std::vector<RoadGrid::Place> m_place; //!< where each vehicle was when the bench started
+  std::vector<double> m_offset; //!< offset along the road of each vehicle when the bench started
+  std::vector<double> m_length; //!< length of a walk step of each vehicle, signed like the offsets
+  std::vector<Step> m_turns; //!< the next turn of the vehicles that reach one
+  std::vector<Step> m_lanes; //!< the next lane change of the vehicles that reach one
+  std::vector<double> m_coordinates; //!< coordinates for CalPercent
+};
+
+} // namespace ns3
+
+/** What a measure found. */
+struct Measure
+{
+  double ns;          //!< time per operation in nanoseconds
+  double allocations; //!< heap allocations per operation
+};
+
+/** The start of a measure. */
+static std::chrono::steady_clock::time_point g_start;
+/** The allocations made before the start of a measure. */
+static uint64_t g_startAllocations;
+
+static void
+Start (void)
+{
+  g_startAllocations = g_allocations;
+  g_start = std::chrono::steady_clock::now ();
+}
+
+/**
+ * \param n the number of operations measured since Start
+ * \return the time and allocations per operation
+ */
+static Measure
+Stop (uint64_t n)
+{
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now () - g_start;
+  Measure m = { elapsed.count () / n, (double) (g_allocations - g_startAllocations) / n };
+  return m;
+}
+
+/**
+ * \param name the name of the measure
+ * \param m what it found
+ */
+static void
+Print (const std::string &name, const Measure &m)
+{
+  std::cout << std::left << std::setw (20) << name << std::right
+            << std::setw (12) << m.ns << " ns/op"
+            << std::setw (10) << m.allocations << " allocs/op" << std::endl;
+}
+
+namespace ns3 {
+
+IntersectionsBench::IntersectionsBench (const std::vector<Ptr<Intersections> > &models)
+  : m_models (models)
+{
+  for (uint32_t i = 0; i < m_models.size (); i++)
+    {
+      Intersections *model = PeekPointer (m_models[i]);
+      Vector position = model->GetPosition ();
+      Vector speed = model->GetVelocity ();
+      m_place.push_back (model->m_place);
+      m_offset.push_back (model->GetCurrentOffset ());
+      m_length.push_back ((speed.x + speed.y) * 0.1);
+      m_coordinates.push_back (position.x);
+      m_coordinates.push_back (position.y);
+      FindStep (i, true, m_turns);
+      FindStep (i, false, m_lanes);
+    }
+}
+
+void
+IntersectionsBench::FindStep (uint32_t i, bool turn, std::vector<Step> &steps)
+{
+  Intersections *model = PeekPointer (m_models[i]);
+  const RoadGrid &road = *model->m_config->roadGrid;
+  RoadGrid::Place place = m_place[i];
+  place.approach = turn;
+  Step step = { i, m_offset[i], m_offset[i] + m_length[i] };
+  double blocks = 2 * road.GetDistance () / 0.1;
+  for (uint32_t k = 0; k < blocks; k++)
+    {
+      RoadGrid::Step next = road.GetStep (place, step.offset, step.next, model->m_config->bounds);
+      if (next == RoadGrid::REBOUND)
+        {
+          return;
+        }
+      if (next != RoadGrid::WALK)
+        {
+          // a turn near the bounds may throw the vehicle across them; keep
+          // to the inner blocks, where it lands on a road
+          Vector position = model->GetRoadPosition (step.offset);
+          const Rectangle &b = model->m_config->bounds;
+          double d = model->m_config->roadGrid->GetDistance ();
+          if (position.x < b.xMin + d || position.x > b.xMax - d
+              || position.y < b.yMin + d || position.y > b.yMax - d)
+            {
+              return;
+            }
+          steps.push_back (step);
+          return;
+        }
+      step.offset = step.next;
+      step.next += m_length[i];
+    }
+}
+
+void
+IntersectionsBench::RemoveEvents (void)
+{
+  // a cancelled event stays in the scheduler until it expires; removing
+  // it keeps the scheduler at one event per vehicle from one pass to the next
+  for (uint32_t i = 0; i < m_models.size (); i++)
+    {
+      Simulator::Remove (m_models[i]->m_event);
+    }
+}
+
+void
+IntersectionsBench::Restore (uint32_t i)
+{
+  Intersections *model = PeekPointer (m_models[i]);
+  // the turn the step was found for, not the one drawn by the last pass
+  model->m_place = m_place[i];
+}
+
+void
+IntersectionsBench::CalPercent (uint32_t rounds)
+{
+  Intersections *model = PeekPointer (m_models[0]);
+  double sum = 0;
+  Start ();
+  for (uint32_t r = 0; r < rounds; r++)
+    {
+      for (uint32_t i = 0; i < m_coordinates.size (); i++)
+        {
+          sum += model->CalPercent (m_coordinates[i]);
+        }
+    }
+  Measure m = Stop ((uint64_t) rounds * m_coordinates.size ());
+  Print ("CalPercent", m);
+  NS_ASSERT (sum >= 0);
+}
+
+void
+IntersectionsBench::GetStep (uint32_t rounds)
+{
+  uint64_t hits = 0;
+  Start ();
+  for (uint32_t r = 0; r < rounds; r++)
+    {
+      for (uint32_t i = 0; i < m_models.size (); i++)
+        {
+          Intersections *model = PeekPointer (m_models[i]);
+          hits += model->m_config->roadGrid->GetStep (model->m_place, m_offset[i], m_offset[i] + m_length[i],
+                                                      model->m_config->bounds) != RoadGrid::WALK;
+        }
+    }
+  Measure m = Stop ((uint64_t) rounds * m_models.size ());
+  Print ("RoadGrid::GetStep", m);
+  NS_ASSERT (hits <= (uint64_t) rounds * m_models.size ());
+}
+
+void
+IntersectionsBench::ChangeVelocity (uint32_t rounds)
+{
+  Measure total = { 0, 0 };
+  for (uint32_t r = 0; r < rounds && !m_turns.empty (); r++)
+    {
+      RemoveEvents ();
+      for (uint32_t k = 0; k < m_turns.size (); k++)
+        {
+          Restore (m_turns[k].vehicle);
+        }
+      Start ();
+      for (uint32_t k = 0; k < m_turns.size (); k++)
+        {
+          const Step &step = m_turns[k];
+          m_models[step.vehicle]->ChangeVelocity (step.offset, step.next);
+        }
+      Measure m = Stop (m_turns.size ());
+      total.ns += m.ns / rounds;
+      total.allocations += m.allocations / rounds;
+    }
+  if (m_turns.empty ())
+    {
+      std::cout << "ChangeVelocity: no turn in the inner blocks" << std::endl;
+      return;
+    }
+  Print ("ChangeVelocity", total);
+}
+
+void
+IntersectionsBench::ChangeRn (uint32_t rounds)
+{
+  Measure total = { 0, 0 };
+  for (uint32_t r = 0; r < rounds && !m_lanes.empty (); r++)
+    {
+      RemoveEvents ();
+      for (uint32_t k = 0; k < m_lanes.size (); k++)
+        {
+          Restore (m_lanes[k].vehicle);
+        }
+      Start ();
+      for (uint32_t k = 0; k < m_lanes.size (); k++)
+        {
+          const Step &step = m_lanes[k];
+          m_models[step.vehicle]->ChangeRN (step.offset);
+        }
+      Measure m = Stop (m_lanes.size ());
+      total.ns += m.ns / rounds;
+      total.allocations += m.allocations / rounds;
+    }
+  if (m_lanes.empty ())
+    {
+      std::cout << "ChangeRN: no lane change in the inner blocks" << std::endl;
+      return;
+    }
+  Print ("ChangeRN", total);
+}
+
+void
+IntersectionsBench::GetPositionCold (uint32_t rounds)
+{
+  double sum = 0;
+  Start ();
+  for (uint32_t r = 0; r < rounds; r++)
+    {
+      for (uint32_t i = 0; i < m_models.size (); i++)
+        {
+          // as after a change of course
+          m_models[i]->m_positionValid = false;
+          sum += m_models[i]->DoGetPosition ().x;
+        }
+    }
+  Measure m = Stop ((uint64_t) rounds * m_models.size ());
+  Print ("DoGetPosition", m);
+  NS_ASSERT (sum >= 0);
+}
+
+void
+IntersectionsBench::GetPositionCached (uint32_t rounds)
+{
+  double sum = 0;
+  Start ();
+  for (uint32_t r = 0; r < rounds; r++)
+    {
+      for (uint32_t i = 0; i < m_models.size (); i++)
+        {
+          sum += m_models[i]->DoGetPosition ().x;
+        }
+    }
+  Measure m = Stop ((uint64_t) rounds * m_models.size ());
+  Print ("DoGetPosition hit", m);
+  NS_ASSERT (sum >= 0);
+}
+
+void
+IntersectionsBench::ChangedDirection (uint32_t rounds)
+{
+  int sum = 0;
+  Start ();
+  for (uint32_t r = 0; r < rounds; r++)
+    {
+      for (uint32_t i = 0; i < m_models.size (); i++)
+        {
+          sum += m_models[i]->ChangedDirection ();
+        }
+    }
+  Measure m = Stop ((uint64_t) rounds * m_models.size ());
+  Print ("ChangedDirection", m);
+  NS_ASSERT (sum >= 0);
+}
+
+} // namespace ns3
+
+int main (int argc, char *argv[])
+{
+  uint32_t vehicles = 1000;
+  uint32_t grid = 2;
+  uint32_t intersection = 10;
+  double distance = 1000;
+  uint32_t rounds = 100;
+  double warmup = 10;
+
+  CommandLine cmd;
+  cmd.AddValue ("vehicles", "number of vehicles", vehicles);
+  cmd.AddValue ("grid", "number of lanes", grid);
+  cmd.AddValue ("intersection", "number of intersections on each axis", intersection);
+  cmd.AddValue ("distance", "distance between intersections", distance);
+  cmd.AddValue ("rounds", "number of passes over the vehicles per measure", rounds);
+  cmd.AddValue ("warmup", "seconds of simulation before the measures", warmup);
+  cmd.Parse (argc, argv);
+
+  Ptr<RoadGrid> roadGrid = CreateObject<RoadGrid> ();
+  roadGrid->SetGrid (grid);
+  roadGrid->SetIntersection (intersection);
+  roadGrid->SetDistance (distance);
+
+  Ptr<IntersectionsPosition> positions = CreateObject<IntersectionsPosition> ();
+  positions->SetAttribute ("Num", UintegerValue (vehicles));
+  positions->SetAttribute ("RoadGrid", PointerValue (roadGrid));
+
+  std::vector<Ptr<Intersections> > models;
+  for (uint32_t i = 0; i < vehicles; i++)
+    {
+      Ptr<Intersections> model = CreateObject<Intersections> ();
+      model->SetRoadGrid (roadGrid);
+      model->SetPosition (positions->GetNext ());
+      model->Initialize ();
+      models.push_back (model);
+    }
+  Simulator::Stop (Seconds (warmup));
+  Simulator::Run ();
+
+  std::cout << vehicles << " vehicles, " << intersection << "x" << intersection
+            << " intersections " << distance << " m apart, " << grid << " lanes, "
+            << rounds << " rounds" << std::endl;
+
+  // a fresh allocator, so half the positions are on each road direction
+  uint64_t n = (uint64_t) rounds * vehicles;
+  Ptr<IntersectionsPosition> timed = CreateObject<IntersectionsPosition> ();
+  timed->SetAttribute ("Num", UintegerValue (n));
+  timed->SetAttribute ("RoadGrid", PointerValue (roadGrid));
+  double sum = 0;
+  Start ();
+  for (uint64_t i = 0; i < n; i++)
+    {
+      sum += timed->GetNext ().x;
+    }
+  Print ("GetNext", Stop (n));
+  NS_ASSERT (sum >= 0);
+
+  Ptr<IntersectionsPosition> batched = CreateObject<IntersectionsPosition> ();
+  batched->SetAttribute ("Num", UintegerValue (n));
+  batched->SetAttribute ("RoadGrid", PointerValue (roadGrid));
+  std::vector<Vector> batch (vehicles);
+  Start ();
+  for (uint32_t r = 0; r < rounds; r++)
+    {
+      batched->GetNextBatch (&batch[0], vehicles);
+    }
+  Print ("GetNextBatch", Stop (n));
+
+  IntersectionsBench bench (models);
+  bench.CalPercent (rounds);
+  bench.GetStep (rounds);
+  bench.GetPositionCold (rounds);
+  bench.GetPositionCached (rounds);
+  bench.ChangedDirection (rounds);
+  bench.ChangeVelocity (rounds);
+  bench.ChangeRn (rounds);
+
+  models.clear ();
+  Simulator::Destroy ();
+  return 0;
+}
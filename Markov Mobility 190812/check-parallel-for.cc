@@ -0,0 +1,212 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Check that ParallelFor runs every item exactly once, in ranges of at
+// most a grain, for item counts around the chunk edges and thread counts
+// from 1 to more threads than chunks, with some slow items so that the
+// threads steal from each other. Then check that IntersectionsBatch
+// drives the same trajectories on 1 to --threads threads. The program
+// fails on the first difference.
+//
+// ./waf --run "check-parallel-for --threads=8 --vehicles=1000"
+
+#include "parallel-for.h"
+#include "intersections-batch.h"
+#include "position-allocator.h"
+#include "road-grid.h"
+#include "ns3/command-line.h"
+#include "ns3/double.h"
+#include "ns3/pointer.h"
+#include "ns3/uinteger.h"
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace ns3;
+
+/** What the ranges of one ParallelFor saw, shared by its threads. */
+struct Coverage
+{
+  uint32_t n;                               //!< number of items
+  uint32_t grain;                           //!< items of a chunk
+  std::unique_ptr<std::atomic<uint32_t>[]> runs; //!< times each item was run
+  std::atomic<uint32_t> badRanges;          //!< ranges out of [0, n), or over a grain but not all of it
+  std::atomic<uint64_t> sink;               //!< keeps the slow items from being optimized out
+};
+
+/**
+ * Count the items of a range, slowly for one item in seven.
+ */
+static void
+Cover (void *context, uint32_t begin, uint32_t end)
+{
+  Coverage *c = static_cast<Coverage *> (context);
+  // a single thread runs all the items as one range
+  bool all = begin == 0 && end == c->n;
+  if (begin >= end || end > c->n || (end - begin > c->grain && !all))
+    {
+      c->badRanges++;
+      return;
+    }
+  for (uint32_t i = begin; i < end; i++)
+    {
+      c->runs[i]++;
+      if (i % 7 == 0)
+        {
+          uint64_t x = i;
+          for (uint32_t k = 0; k < 2000; k++)
+            {
+              x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            }
+          c->sink += x;
+        }
+    }
+}
+
+/**
+ * \param n the number of items
+ * \param threads the number of threads
+ * \param grain the items of a chunk
+ * \return false, after printing why, if an item was not run exactly once
+ */
+static bool
+CheckCoverage (uint32_t n, uint32_t threads, uint32_t grain)
+{
+  Coverage c;
+  c.n = n;
+  c.grain = grain;
+  c.runs.reset (new std::atomic<uint32_t>[n + 1]);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      c.runs[i] = 0;
+    }
+  c.badRanges = 0;
+  c.sink = 0;
+  uint32_t used = ParallelFor (n, threads, grain, &Cover, &c);
+
+  bool ok = c.badRanges == 0 && used >= 1 && (threads == 0 || used <= threads);
+  for (uint32_t i = 0; ok && i < n; i++)
+    {
+      ok = c.runs[i] == 1;
+    }
+  if (!ok)
+    {
+      std::cerr << n << " items, " << threads << " threads, grain " << grain << ": "
+                << used << " threads used, " << c.badRanges << " bad ranges" << std::endl;
+    }
+  return ok;
+}
+
+/**
+ * \param a the segments of a run
+ * \param b the segments of another run
+ * \return true if they are the same, bit for bit
+ */
+static bool
+Same (const std::vector<std::vector<IntersectionsBatch::Segment> > &a,
+      const std::vector<std::vector<IntersectionsBatch::Segment> > &b)
+{
+  if (a.size () != b.size ())
+    {
+      return false;
+    }
+  for (uint32_t v = 0; v < a.size (); v++)
+    {
+      if (a[v].size () != b[v].size ())
+        {
+          return false;
+        }
+      for (uint32_t i = 0; i < a[v].size (); i++)
+        {
+          const IntersectionsBatch::Segment &x = a[v][i];
+          const IntersectionsBatch::Segment &y = b[v][i];
+          if (x.time != y.time || x.position.x != y.position.x || x.position.y != y.position.y
+              || x.velocity.x != y.velocity.x || x.velocity.y != y.velocity.y)
+            {
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t threads = 8;
+  uint32_t vehicles = 1000;
+  double time = 600;
+
+  CommandLine cmd;
+  cmd.AddValue ("threads", "highest number of threads to check", threads);
+  cmd.AddValue ("vehicles", "number of vehicles driven by IntersectionsBatch", vehicles);
+  cmd.AddValue ("time", "seconds IntersectionsBatch drives for", time);
+  cmd.Parse (argc, argv);
+
+  uint32_t wrong = 0;
+  uint32_t checks = 0;
+  uint32_t grains[] = { 1, 3, 64, 1024 };
+  for (uint32_t g = 0; g < sizeof (grains) / sizeof (grains[0]); g++)
+    {
+      uint32_t grain = grains[g];
+      uint32_t counts[] = { 0, 1, 2, grain - 1, grain, grain + 1, 5 * grain - 1, 5 * grain + 1, 100003 };
+      for (uint32_t c = 0; c < sizeof (counts) / sizeof (counts[0]); c++)
+        {
+          for (uint32_t t = 0; t <= threads + 1; t++)
+            {
+              checks++;
+              wrong += !CheckCoverage (counts[c], t, grain);
+            }
+        }
+    }
+  std::cout << "ParallelFor: " << checks << " runs checked, " << wrong << " wrong" << std::endl;
+
+  Ptr<RoadGrid> road = CreateObject<RoadGrid> ();
+  road->SetGrid (2);
+  road->SetIntersection (5);
+  road->SetDistance (500);
+  Ptr<IntersectionsPosition> position = CreateObject<IntersectionsPosition> ();
+  position->SetAttribute ("Num", UintegerValue (vehicles));
+  position->SetAttribute ("RoadGrid", PointerValue (road));
+  Ptr<IntersectionsBatch> batch = CreateObject<IntersectionsBatch> ();
+  batch->SetAttribute ("RoadGrid", PointerValue (road));
+  batch->SetAttribute ("MinSpeed", DoubleValue (10));
+  batch->SetAttribute ("MaxSpeed", DoubleValue (20));
+  // small chunks, for the threads to steal some
+  batch->SetAttribute ("Grain", UintegerValue (16));
+  for (uint32_t i = 0; i < vehicles; i++)
+    {
+      batch->Add (position->GetNext ());
+    }
+  std::vector<std::vector<IntersectionsBatch::Segment> > first;
+  batch->SetAttribute ("Threads", UintegerValue (1));
+  batch->Run (Seconds (time), first);
+  uint32_t differ = 0;
+  for (uint32_t t = 2; t <= threads; t++)
+    {
+      std::vector<std::vector<IntersectionsBatch::Segment> > segments;
+      batch->SetAttribute ("Threads", UintegerValue (t));
+      batch->Run (Seconds (time), segments);
+      if (!Same (first, segments))
+        {
+          std::cerr << "IntersectionsBatch: " << t << " threads drive other trajectories than 1" << std::endl;
+          differ++;
+        }
+    }
+  std::cout << "IntersectionsBatch: " << vehicles << " vehicles on 1 to " << threads
+            << " threads, " << differ << " runs differ" << std::endl;
+  return wrong == 0 && differ == 0 ? 0 : 1;
+}
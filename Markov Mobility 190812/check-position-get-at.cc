@@ -0,0 +1,247 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Check GetAt of the position allocators against GetNext. For
+// GridPositionAllocator and FileListPositionAllocator position i must be
+// the i-th one of GetNext. IntersectionsPosition and AIntersectionPosition
+// draw from other streams, so position i must only be laid out like the
+// i-th one of GetNext: on the same kind of lane, with only the random
+// part differing. GetAt must also give the same positions in reverse
+// order and on a second allocator with the same Seed. The program fails
+// on the first difference.
+//
+// ./waf --run "check-position-get-at --n=10000"
+
+#include "position-allocator.h"
+#include "road-grid.h"
+#include "ns3/command-line.h"
+#include "ns3/double.h"
+#include "ns3/pointer.h"
+#include "ns3/uinteger.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \param what the check
+ * \param i the index of the position
+ * \param a a position
+ * \param b the position it should be
+ * \return false, after printing both, if a is not b
+ */
+static bool
+Equal (const char *what, uint32_t i, const Vector &a, const Vector &b)
+{
+  if (a.x == b.x && a.y == b.y && a.z == b.z)
+    {
+      return true;
+    }
+  std::cerr << what << ", position " << i << ": " << a << " instead of " << b << std::endl;
+  return false;
+}
+
+/**
+ * \brief Check that GetAt does not depend on the order of the calls
+ * \param what the allocator checked
+ * \param allocator the allocator
+ * \param other an allocator with the same attributes
+ * \param n the number of positions
+ * \return false if a position changed
+ */
+static bool
+CheckOrder (const char *what, Ptr<PositionAllocator> allocator, Ptr<PositionAllocator> other, uint32_t n)
+{
+  std::vector<Vector> forward (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      forward[i] = allocator->GetAt (i);
+    }
+  bool ok = true;
+  for (uint32_t i = n; ok && i-- > 0; )
+    {
+      ok = Equal (what, i, allocator->GetAt (i), forward[i])
+        && Equal (what, i, other->GetAt (i), forward[i]);
+    }
+  return ok;
+}
+
+/**
+ * \return false if GetAt of a GridPositionAllocator differs from GetNext
+ */
+static bool
+CheckGrid (uint32_t n, enum GridPositionAllocator::LayoutType layout)
+{
+  Ptr<GridPositionAllocator> grid = CreateObject<GridPositionAllocator> ();
+  grid->SetMinX (-10);
+  grid->SetMinY (5);
+  grid->SetDeltaX (2.5);
+  grid->SetDeltaY (7);
+  grid->SetN (13);
+  grid->SetLayoutType (layout);
+  bool ok = true;
+  for (uint32_t i = 0; ok && i < n; i++)
+    {
+      ok = Equal ("GridPositionAllocator", i, grid->GetAt (i), grid->GetNext ());
+    }
+  return ok;
+}
+
+/**
+ * \return false if GetAt of a FileListPositionAllocator differs from GetNext
+ */
+static bool
+CheckFileList (uint32_t n)
+{
+  std::vector<Vector> positions (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      positions[i] = Vector (i * 0.5, -1.0 * i, i % 3);
+    }
+  std::string filename = "check-position-get-at.pos";
+  FileListPositionAllocator::Write (filename, positions);
+  Ptr<FileListPositionAllocator> list = CreateObject<FileListPositionAllocator> ();
+  list->Open (filename);
+  bool ok = list->GetSize () == n;
+  for (uint32_t i = 0; ok && i < n; i++)
+    {
+      ok = Equal ("FileListPositionAllocator", i, list->GetAt (i), list->GetNext ())
+        && Equal ("FileListPositionAllocator", i, list->GetAt (i), positions[i]);
+    }
+  // GetNext starts over, GetAt does not move
+  ok = ok && Equal ("FileListPositionAllocator", n, list->GetNext (), list->GetAt (0));
+  list->Dispose ();
+  std::remove (filename.c_str ());
+  return ok;
+}
+
+/**
+ * \return false if a position of GetAt of IntersectionsPosition is not
+ *         on the kind of lane the same position of GetNext is on
+ */
+static bool
+CheckIntersections (uint32_t n)
+{
+  Ptr<RoadGrid> road = CreateObject<RoadGrid> ();
+  road->SetGrid (3);
+  road->SetIntersection (4);
+  road->SetDistance (400);
+  std::set<double> lanes;
+  for (uint32_t i = 0; i < road->GetIntersection (); i++)
+    {
+      for (uint32_t l = 0; l < road->GetGrid (); l++)
+        {
+          lanes.insert (road->GetRoadCentre (i) + road->GetLaneCentre (l));
+          lanes.insert (road->GetRoadCentre (i) - road->GetLaneCentre (l));
+        }
+    }
+  double size = road->GetBounds ().xMax;
+
+  Ptr<IntersectionsPosition> positions[2];
+  for (uint32_t k = 0; k < 2; k++)
+    {
+      positions[k] = CreateObject<IntersectionsPosition> ();
+      positions[k]->SetAttribute ("Num", UintegerValue (n));
+      positions[k]->SetAttribute ("RoadGrid", PointerValue (road));
+      positions[k]->SetAttribute ("Seed", UintegerValue (7));
+    }
+  bool ok = true;
+  for (uint32_t i = 0; ok && i < n; i++)
+    {
+      Vector next = positions[0]->GetNext ();
+      Vector at = positions[0]->GetAt (i);
+      // the first half on the vertical roads, the rest on the horizontal ones
+      bool vertical = i < n / 2;
+      double nextAcross = vertical ? next.x : next.y;
+      double atAcross = vertical ? at.x : at.y;
+      double atAlong = vertical ? at.y : at.x;
+      ok = lanes.count (nextAcross) == 1 && lanes.count (atAcross) == 1
+        && atAlong >= 0 && atAlong < size;
+      if (!ok)
+        {
+          std::cerr << "IntersectionsPosition, position " << i << ": " << at
+                    << " is not laid out like " << next << std::endl;
+        }
+    }
+  return ok && CheckOrder ("IntersectionsPosition", positions[0], positions[1], n);
+}
+
+/**
+ * \return false if a position of GetAt of AIntersectionPosition is not
+ *         the same position of GetNext up to its random offset
+ */
+static bool
+CheckAIntersection (uint32_t n)
+{
+  uint32_t grid = 2;
+  double bound = 3000;
+  if (n / (2 * grid) < 2)
+    {
+      // the layout needs two vehicles on each half of a lane
+      std::cout << "AIntersectionPosition: not checked, fewer than " << 4 * grid << " positions" << std::endl;
+      return true;
+    }
+  Ptr<AIntersectionPosition> positions[2];
+  for (uint32_t k = 0; k < 2; k++)
+    {
+      positions[k] = CreateObject<AIntersectionPosition> ();
+      positions[k]->SetAttribute ("Num", UintegerValue (n));
+      positions[k]->SetAttribute ("Grid", UintegerValue (grid));
+      positions[k]->SetAttribute ("Bound", DoubleValue (bound));
+      positions[k]->SetAttribute ("Seed", UintegerValue (7));
+    }
+  // the offsets are whole meters below the spacing of the vehicles
+  double spacing = (bound - grid * 3) / (n / (2 * grid));
+  bool ok = true;
+  for (uint32_t i = 0; ok && i < n; i++)
+    {
+      Vector next = positions[0]->GetNext ();
+      Vector at = positions[0]->GetAt (i);
+      bool vertical = i <= n / 2;
+      double across = (vertical ? at.x : at.y) - (vertical ? next.x : next.y);
+      double along = (vertical ? at.y : at.x) - (vertical ? next.y : next.x);
+      // up to the rounding of the sums
+      ok = across == 0 && std::fabs (along - std::floor (along + 0.5)) < 1e-9 * bound
+        && std::fabs (along) < spacing;
+      if (!ok)
+        {
+          std::cerr << "AIntersectionPosition, position " << i << ": " << at
+                    << " is not laid out like " << next << std::endl;
+        }
+    }
+  return ok && CheckOrder ("AIntersectionPosition", positions[0], positions[1], n);
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t n = 10000;
+
+  CommandLine cmd;
+  cmd.AddValue ("n", "number of positions to check on each allocator", n);
+  cmd.Parse (argc, argv);
+
+  bool ok = CheckGrid (n, GridPositionAllocator::ROW_FIRST)
+    && CheckGrid (n, GridPositionAllocator::COLUMN_FIRST)
+    && CheckFileList (n)
+    && CheckIntersections (n)
+    && CheckAIntersection (n);
+  std::cout << n << " positions of each allocator: GetAt "
+            << (ok ? "agrees with GetNext" : "WRONG") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Write a trajectory trace whose deltas fall on either side of every
+// varint length up to 2^48 units, and random ones, read it back through
+// TrajectoryTraceFile and check that every waypoint comes back in the
+// units it was written in. The program fails on the first difference.
+//
+// ./waf --run "check-trajectory-trace --waypoints=100000 --output=check.trc"
+
+#include "trajectory-trace.h"
+#include "ns3/command-line.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/string.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace ns3;
+
+/** A waypoint in units of the resolutions: time, x, y, velocity x and y. */
+struct Units
+{
+  int64_t value[5]; //!< the values
+};
+
+static const double g_timeResolution = 0.001;     //!< seconds per time unit
+static const double g_positionResolution = 0.01;  //!< meters per position unit
+static const double g_velocityResolution = 0.001; //!< m/s per velocity unit
+
+/**
+ * \param writer the writer
+ * \param vehicle the vehicle
+ * \param u the waypoint
+ */
+static void
+Add (TrajectoryTraceWriter &writer, uint32_t vehicle, const Units &u)
+{
+  writer.AddSeconds (vehicle, u.value[0] * g_timeResolution,
+                     Vector (u.value[1] * g_positionResolution, u.value[2] * g_positionResolution, 0),
+                     Vector (u.value[3] * g_velocityResolution, u.value[4] * g_velocityResolution, 0));
+}
+
+/**
+ * \brief Read the waypoints of a vehicle back and compare them
+ * \param file the trace
+ * \param vehicle the vehicle
+ * \param written the waypoints written for it
+ * \return false, after printing the first difference, if they differ
+ */
+static bool
+Check (Ptr<TrajectoryTraceFile> file, uint32_t vehicle, const std::vector<Units> &written)
+{
+  TrajectoryTraceCursor cursor = file->GetCursor (vehicle);
+  if (cursor.GetRemaining () != written.size ())
+    {
+      std::cerr << "vehicle " << vehicle << ": " << cursor.GetRemaining ()
+                << " waypoints read, " << written.size () << " written" << std::endl;
+      return false;
+    }
+  Time time;
+  Vector position, velocity;
+  for (uint32_t i = 0; cursor.Next (time, position, velocity); i++)
+    {
+      int64_t read[5];
+      read[0] = std::llround (time.GetSeconds () / g_timeResolution);
+      read[1] = std::llround (position.x / g_positionResolution);
+      read[2] = std::llround (position.y / g_positionResolution);
+      read[3] = std::llround (velocity.x / g_velocityResolution);
+      read[4] = std::llround (velocity.y / g_velocityResolution);
+      for (int k = 0; k < 5; k++)
+        {
+          if (read[k] != written[i].value[k])
+            {
+              std::cerr << "vehicle " << vehicle << ", waypoint " << i << ", value " << k
+                        << ": read " << read[k] << ", written " << written[i].value[k] << std::endl;
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t waypoints = 100000;
+  std::string output = "check.trc";
+
+  CommandLine cmd;
+  cmd.AddValue ("waypoints", "number of random waypoints", waypoints);
+  cmd.AddValue ("output", "trace file to write and read back", output);
+  cmd.Parse (argc, argv);
+
+  TrajectoryTraceWriter writer;
+  writer.SetResolution (Seconds (g_timeResolution), g_positionResolution, g_velocityResolution);
+  std::vector<std::vector<Units> > written (3);
+
+  // vehicle 0: deltas of 0, and just below and above each 7-bit length
+  // of a zigzag varint, in both directions; the values stay below 2^50
+  // units, which a double in meters still holds to the unit
+  Units u = { { 0, 0, 0, 0, 0 } };
+  written[0].push_back (u);
+  written[0].push_back (u);
+  for (int bits = 6; bits <= 48; bits += 7)
+    {
+      int64_t edge = (int64_t) 1 << bits;
+      int64_t deltas[] = { edge - 1, edge, -edge, -edge - 1 };
+      for (uint32_t d = 0; d < 4; d++)
+        {
+          // time only goes forward, and stays within the range of Time
+          u.value[0] += bits <= 41 && deltas[d] > 0 ? deltas[d] : 1;
+          for (int k = 1; k < 5; k++)
+            {
+              u.value[k] += k % 2 ? deltas[d] : -deltas[d];
+            }
+          written[0].push_back (u);
+        }
+    }
+
+  // vehicle 1: no waypoint at all
+
+  // vehicle 2: random deltas of random lengths
+  Ptr<UniformRandomVariable> rv = CreateObject<UniformRandomVariable> ();
+  Units r = { { 0, 0, 0, 0, 0 } };
+  for (uint32_t i = 0; i < waypoints; i++)
+    {
+      r.value[0] += rv->GetInteger (0, 1000);
+      for (int k = 1; k < 5; k++)
+        {
+          int64_t magnitude = (int64_t) 1 << rv->GetInteger (0, 40);
+          r.value[k] = (int64_t) (rv->GetValue (-1, 1) * magnitude);
+        }
+      written[2].push_back (r);
+    }
+
+  for (uint32_t vehicle = 0; vehicle < written.size (); vehicle++)
+    {
+      writer.Reserve (vehicle + 1);
+      for (uint32_t i = 0; i < written[vehicle].size (); i++)
+        {
+          Add (writer, vehicle, written[vehicle][i]);
+        }
+    }
+  writer.Write (output);
+
+  Ptr<TrajectoryTraceFile> file = CreateObject<TrajectoryTraceFile> ();
+  file->SetAttribute ("Filename", StringValue (output));
+  bool ok = file->GetN () == written.size ();
+  if (!ok)
+    {
+      std::cerr << file->GetN () << " vehicles read, " << written.size () << " written" << std::endl;
+    }
+  for (uint32_t vehicle = 0; ok && vehicle < written.size (); vehicle++)
+    {
+      ok = Check (file, vehicle, written[vehicle]);
+    }
+  std::cout << writer.GetWaypoints () << " waypoints written to " << output
+            << (ok ? ", read back unchanged" : ", read back WRONG") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Check the turns drawn from the alias tables of TurnPool against the
+// threshold chain Intersections::ChangedDirection used to draw them
+// with, on the floored percentages: the exact probabilities of the
+// tables for every count up to --counts of each turn and a few
+// degenerate weights, then that counting turns one by one re-points the
+// counts to the table of their totals, across the halving at 2^16, and
+// last the frequencies of --draws turns drawn from the pool for some
+// counts. The program fails if a table is off by more than its 2^-32
+// rounding or a frequency by more than five standard deviations.
+//
+// ./waf --run "check-turn-pool --counts=30 --draws=1000000"
+
+#include "turn-pool.h"
+#include "ns3/command-line.h"
+#include "ns3/random-variable-stream.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace ns3;
+
+/**
+ * \brief The distribution of the old threshold chain, on whole percents
+ * \param p the straight, right and left counts
+ * \param prob set to the probabilities of going straight, right and left
+ */
+static void
+GetChain (const uint32_t p[3], double prob[3])
+{
+  uint32_t num = p[0] + p[1] + p[2];
+  double pp0 = 100 * p[0] / num;
+  double pp1 = 100 * p[1] / num;
+  // straight below the first threshold, right below the second
+  double first = std::min (pp0 >= 5 ? pp0 : 5, 100.0);
+  double second = std::min (pp1 >= 5 ? pp0 + pp1 : pp0 + 5, 100.0);
+  prob[0] = first / 100;
+  prob[1] = std::max (second - first, 0.0) / 100;
+  prob[2] = 1 - prob[0] - prob[1];
+}
+
+/**
+ * \brief The exact distribution of an alias table
+ * \param alias the table
+ * \param prob set to the probabilities of going straight, right and left
+ */
+static void
+GetTable (const TurnAlias &alias, double prob[3])
+{
+  prob[0] = prob[1] = prob[2] = 0;
+  for (uint32_t k = 0; k < 3; k++)
+    {
+      double keep = alias.threshold[k] / 4294967296.0;
+      prob[k] += keep / 3;
+      prob[alias.alias[k]] += (1 - keep) / 3;
+    }
+}
+
+/**
+ * \param expected the expected probabilities
+ * \param prob the probabilities found
+ * \param tolerance the difference accepted on each of them
+ * \return false if a probability is off by more than the tolerance
+ */
+static bool
+Near (const double expected[3], const double prob[3], double tolerance)
+{
+  return std::fabs (prob[0] - expected[0]) <= tolerance
+    && std::fabs (prob[1] - expected[1]) <= tolerance
+    && std::fabs (prob[2] - expected[2]) <= tolerance;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t counts = 30;
+  uint32_t draws = 1000000;
+
+  CommandLine cmd;
+  cmd.AddValue ("counts", "highest count of each turn to check the tables of", counts);
+  cmd.AddValue ("draws", "number of turns drawn for each frequency check", draws);
+  cmd.Parse (argc, argv);
+
+  uint32_t wrong = 0;
+  uint32_t tables = 0;
+  // three columns of 2^-32 rounding each
+  double rounding = 3 * 4.0 / 4294967296.0;
+
+  double weights[][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 0 }, { 0, 1, 1 },
+                          { 1, 0, 1 }, { 1, 1, 1 }, { 0.001, 1, 1000 }, { 1000, 0.001, 1 } };
+  for (uint32_t i = 0; i < sizeof (weights) / sizeof (weights[0]); i++)
+    {
+      TurnAlias alias;
+      alias.Build (weights[i]);
+      double total = weights[i][0] + weights[i][1] + weights[i][2];
+      double expected[3] = { weights[i][0] / total, weights[i][1] / total, weights[i][2] / total };
+      double prob[3];
+      GetTable (alias, prob);
+      tables++;
+      if (!Near (expected, prob, rounding))
+        {
+          std::cerr << "weights " << weights[i][0] << " " << weights[i][1] << " " << weights[i][2]
+                    << ": table gives " << prob[0] << " " << prob[1] << " " << prob[2] << std::endl;
+          wrong++;
+        }
+    }
+
+  uint32_t p[3];
+  for (p[0] = 0; p[0] <= counts; p[0]++)
+    {
+      for (p[1] = 0; p[1] <= counts; p[1]++)
+        {
+          for (p[2] = p[0] + p[1] == 0 ? 1 : 0; p[2] <= counts; p[2]++)
+            {
+              double expected[3], prob[3];
+              GetChain (p, expected);
+              GetTable (TurnPool::GetAlias (p), prob);
+              tables++;
+              if (!Near (expected, prob, rounding))
+                {
+                  std::cerr << "counts " << p[0] << " " << p[1] << " " << p[2]
+                            << ": table gives " << prob[0] << " " << prob[1] << " " << prob[2]
+                            << ", the chain " << expected[0] << " " << expected[1] << " " << expected[2] << std::endl;
+                  wrong++;
+                }
+            }
+        }
+    }
+
+  // count through a pool, as the models do, past the 16 bit halving
+  Ptr<TurnPool> pool = CreateObject<TurnPool> ();
+  Ptr<UniformRandomVariable> rv = CreateObject<UniformRandomVariable> ();
+  TurnCounts vehicle;
+  uint32_t q[3] = { 40, 30, 30 };
+  pool->Start (vehicle, q[0], q[1], q[2]);
+  for (uint32_t k = 0; k < 300000; k++)
+    {
+      uint8_t turn = rv->GetInteger (0, 2) == 0 ? 0 : k % 3;
+      if (q[turn] == 0xffff)
+        {
+          q[0] = (q[0] + 1) / 2;
+          q[1] = (q[1] + 1) / 2;
+          q[2] = (q[2] + 1) / 2;
+        }
+      q[turn]++;
+      pool->Count (vehicle, turn);
+      TurnCounts expected;
+      pool->Start (expected, q[0], q[1], q[2]);
+      if (vehicle.p[0] != q[0] || vehicle.p[1] != q[1] || vehicle.p[2] != q[2] || vehicle.table != expected.table)
+        {
+          std::cerr << "turn " << k << ": counts " << vehicle.p[0] << " " << vehicle.p[1] << " " << vehicle.p[2]
+                    << " on table " << vehicle.table << " instead of " << q[0] << " " << q[1] << " " << q[2]
+                    << " on table " << expected.table << std::endl;
+          wrong++;
+          break;
+        }
+    }
+  tables++;
+
+  uint32_t sampled[][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 33, 33, 34 },
+                            { 2, 50, 48 }, { 90, 3, 7 }, { 7, 7, 86 } };
+  for (uint32_t i = 0; i < sizeof (sampled) / sizeof (sampled[0]); i++)
+    {
+      TurnCounts set;
+      pool->Start (set, sampled[i][0], sampled[i][1], sampled[i][2]);
+      uint32_t hits[3] = { 0, 0, 0 };
+      for (uint32_t d = 0; d < draws; d++)
+        {
+          hits[pool->Sample (set, rv->GetValue (0, 3))]++;
+        }
+      double expected[3], frequency[3];
+      GetChain (sampled[i], expected);
+      bool ok = true;
+      for (uint32_t k = 0; k < 3; k++)
+        {
+          frequency[k] = (double) hits[k] / draws;
+          double sigma = std::sqrt (expected[k] * (1 - expected[k]) / draws);
+          ok = ok && std::fabs (frequency[k] - expected[k]) <= 5 * sigma + rounding;
+        }
+      std::cout << "counts " << sampled[i][0] << " " << sampled[i][1] << " " << sampled[i][2]
+                << ": drawn " << frequency[0] << " " << frequency[1] << " " << frequency[2]
+                << ", expected " << expected[0] << " " << expected[1] << " " << expected[2]
+                << (ok ? "" : " WRONG") << std::endl;
+      wrong += !ok;
+    }
+
+  std::cout << tables << " tables checked, " << wrong << " wrong" << std::endl;
+  return wrong == 0 ? 0 : 1;
+}
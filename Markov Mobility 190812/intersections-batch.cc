@@ -0,0 +1,321 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "intersections-batch.h"
+#include "parallel-for.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/pointer.h"
+#include "ns3/nstime.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("IntersectionsBatch");
+
+NS_OBJECT_ENSURE_REGISTERED (IntersectionsBatch);
+
+TypeId
+IntersectionsBatch::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IntersectionsBatch")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<IntersectionsBatch> ()
+    .AddAttribute ("MinSpeed", "Low end of the speeds (m/s), drawn uniformly.",
+                   DoubleValue (16),
+                   MakeDoubleAccessor (&IntersectionsBatch::m_minSpeed),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("MaxSpeed", "High end of the speeds (m/s); equal to MinSpeed for a constant speed.",
+                   DoubleValue (18),
+                   MakeDoubleAccessor (&IntersectionsBatch::m_maxSpeed),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("DeltaSpeed", "Delta value of speeds",
+                   DoubleValue (5.556),
+                   MakeDoubleAccessor (&IntersectionsBatch::m_delta),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("Step", "Duration of a walk step.",
+                   TimeValue (Seconds (0.1)),
+                   MakeTimeAccessor (&IntersectionsBatch::m_step),
+                   MakeTimeChecker ())
+    .AddAttribute ("RoadGrid", "The road layout to drive on.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsBatch::SetRoadGrid,
+                                        &IntersectionsBatch::GetRoadGrid),
+                   MakePointerChecker<RoadGrid> ())
+    .AddAttribute ("TurnMatrix",
+                   "If set, the turns are drawn from these turning ratios by "
+                   "intersection, approach and previous turn instead of from the "
+                   "Markov counters of the vehicles.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsBatch::m_turnMatrix),
+                   MakePointerChecker<TurnMatrix> ())
+    .AddAttribute ("Seed", "The seed of the random streams of the vehicles.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&IntersectionsBatch::m_seed),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("Threads", "The number of threads, 0 for one per hardware thread.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IntersectionsBatch::m_threads),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Grain", "The number of vehicles a thread drives before it takes more work.",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&IntersectionsBatch::m_grain),
+                   MakeUintegerChecker<uint32_t> (1))
+  ;
+  return tid;
+}
+
+IntersectionsBatch::IntersectionsBatch ()
+  : m_lastThreads (0)
+{
+}
+
+IntersectionsBatch::~IntersectionsBatch ()
+{
+}
+
+IntersectionsBatch::Vehicle::Vehicle (uint64_t seed, uint32_t index)
+  : rng (seed, index)
+{
+}
+
+void
+IntersectionsBatch::DoDispose (void)
+{
+  m_roadGrid = 0;
+  m_turnMatrix = 0;
+  Object::DoDispose ();
+}
+
+void
+IntersectionsBatch::SetRoadGrid (Ptr<RoadGrid> roadGrid)
+{
+  m_roadGrid = roadGrid;
+  if (m_roadGrid != 0)
+    {
+      m_bounds = m_roadGrid->GetBounds ();
+    }
+}
+
+Ptr<RoadGrid>
+IntersectionsBatch::GetRoadGrid (void) const
+{
+  return m_roadGrid;
+}
+
+uint32_t
+IntersectionsBatch::Add (const Vector &position)
+{
+  NS_ABORT_MSG_IF (m_roadGrid == 0, "IntersectionsBatch: no RoadGrid set");
+  NS_ASSERT (m_bounds.IsInside (position));
+  m_start.push_back (position);
+  return m_start.size () - 1;
+}
+
+uint32_t
+IntersectionsBatch::GetN (void) const
+{
+  return m_start.size ();
+}
+
+uint32_t
+IntersectionsBatch::GetThreads (void) const
+{
+  return m_lastThreads;
+}
+
+void
+IntersectionsBatch::Run (Time duration, TrajectoryTraceWriter &writer) const
+{
+  writer.Reserve (m_start.size ());
+  DoRun (duration, &writer, 0);
+}
+
+void
+IntersectionsBatch::Run (Time duration, std::vector<std::vector<Segment> > &segments) const
+{
+  segments.assign (m_start.size (), std::vector<Segment> ());
+  DoRun (duration, 0, &segments);
+}
+
+void
+IntersectionsBatch::DoRun (Time duration, TrajectoryTraceWriter *writer,
+                           std::vector<std::vector<Segment> > *segments) const
+{
+  NS_LOG_FUNCTION (this << duration);
+  NS_ABORT_MSG_IF (m_roadGrid == 0, "IntersectionsBatch: no RoadGrid set");
+  NS_ABORT_MSG_IF (m_step.IsStrictlyNegative () || m_step.IsZero (), "IntersectionsBatch: Step must be positive");
+  // a vehicle that does not move would never reach its next action
+  NS_ABORT_MSG_IF (m_minSpeed - m_delta <= 0 || m_maxSpeed < m_minSpeed,
+                   "IntersectionsBatch: speeds must stay positive");
+  Job job;
+  job.batch = this;
+  job.steps = duration.GetTimeStep () / m_step.GetTimeStep ();
+  job.writer = writer;
+  job.segments = segments;
+  m_lastThreads = ParallelFor (m_start.size (), m_threads, m_grain, &IntersectionsBatch::RunRange, &job);
+}
+
+void
+IntersectionsBatch::RunRange (void *job, uint32_t begin, uint32_t end)
+{
+  Job *j = static_cast<Job *> (job);
+  std::vector<Segment> segments;
+  for (uint32_t i = begin; i < end; i++)
+    {
+      if (j->segments != 0)
+        {
+          j->batch->Drive (i, j->steps, (*j->segments)[i]);
+          continue;
+        }
+      segments.clear ();
+      j->batch->Drive (i, j->steps, segments);
+      for (std::vector<Segment>::const_iterator s = segments.begin (); s != segments.end (); ++s)
+        {
+          j->writer->AddSeconds (i, s->time, s->position, s->velocity);
+        }
+    }
+}
+
+void
+IntersectionsBatch::Drive (uint32_t i, uint64_t steps, std::vector<Segment> &segments) const
+{
+  double h = m_step.GetSeconds ();
+  Vehicle v (m_seed, i);
+  Start (v, m_start[i]);
+  RoadGrid::Place &place = v.place;
+  Segment s;
+  s.time = 0;
+  s.position = m_roadGrid->GetPosition (place, place.offset);
+  s.velocity = GetVelocity (v);
+  segments.push_back (s);
+
+  uint64_t done = 0;
+  while (done < steps)
+    {
+      double length = RoadGrid::GetSign (place.heading) * v.velocity * h;
+      double next = place.offset + length;
+      bool changed = true;
+      switch (m_roadGrid->GetStep (place, place.offset, next, m_bounds))
+        {
+        case RoadGrid::WALK:
+          {
+            // the steps on which the fleet would only move on, in one go
+            uint64_t k = std::min (m_roadGrid->GetWalkSteps (place, length, m_bounds) - 1, steps - done);
+            place.block += m_roadGrid->GetBlock (place.offset + length * k, place.offset);
+            done += k;
+            double speed = v.velocity;
+            v.velocity = DrawSpeed (v);
+            changed = v.velocity != speed;
+            break;
+          }
+        case RoadGrid::TURN:
+          Turn (v, next);
+          done++;
+          break;
+        case RoadGrid::LANE:
+          changed = m_roadGrid->ChangeLane (place, place.offset);
+          done++;
+          break;
+        case RoadGrid::REBOUND:
+          m_roadGrid->Rebound (place, next, m_bounds);
+          done++;
+          break;
+        }
+      if (changed && done < steps)
+        {
+          s.time = done * h;
+          s.position = m_roadGrid->GetPosition (place, place.offset);
+          s.velocity = GetVelocity (v);
+          segments.push_back (s);
+        }
+    }
+}
+
+void
+IntersectionsBatch::Start (Vehicle &v, const Vector &position) const
+{
+  RoadGrid::Place &place = v.place;
+  m_roadGrid->Start (place, position);
+
+  v.deltaSpeed = v.rng.GetValue (-m_delta, m_delta);
+
+  v.p[0] = v.rng.GetValue (0, 100);
+  v.p[1] = v.rng.GetValue (0, 100 - v.p[0]);
+  v.p[2] = 100 - v.p[0] - v.p[1];
+  v.entry = 0;
+  if (m_turnMatrix != 0)
+    {
+      // no turn taken yet: as if the vehicle had gone straight
+      place.turn = m_turnMatrix->Sample (position, place.heading, 0, false, v.rng.GetValue (0, 3), v.entry);
+    }
+  else
+    {
+      v.alias = TurnPool::GetAlias (v.p);
+      place.turn = v.alias.Sample (v.rng.GetValue (0, 3));
+    }
+  // the first segment runs at the drawn speed, the turn is encoded from the next one on
+  v.velocity = v.rng.GetValue (m_minSpeed, m_maxSpeed) + v.deltaSpeed;
+}
+
+void
+IntersectionsBatch::Turn (Vehicle &v, double next) const
+{
+  RoadGrid::Place &place = v.place;
+  if (m_turnMatrix == 0)
+    {
+      v.p[place.turn]++;
+      v.alias = TurnPool::GetAlias (v.p);
+    }
+  // the vehicle is still where it was when the turn was decided
+  m_roadGrid->Turn (place, place.offset, next);
+  place.turn = DrawDirection (v);
+  v.velocity = DrawSpeed (v);
+}
+
+Vector
+IntersectionsBatch::GetVelocity (const Vehicle &v) const
+{
+  double speed = RoadGrid::GetSign (v.place.heading) * v.velocity;
+  return v.place.heading < 2 ? Vector (0, speed, 0) : Vector (speed, 0, 0);
+}
+
+double
+IntersectionsBatch::DrawSpeed (Vehicle &v) const
+{
+  double speed = v.rng.GetValue (m_minSpeed, m_maxSpeed) + v.deltaSpeed;
+  int x1 = speed * 1000;
+  int x2 = x1 / 10;
+  return speed - (x1-x2*10)*0.001 + v.place.turn*0.001;
+}
+
+uint8_t
+IntersectionsBatch::DrawDirection (Vehicle &v) const
+{
+  if (m_turnMatrix != 0)
+    {
+      // the place still holds the turn just taken
+      const RoadGrid::Place &place = v.place;
+      return m_turnMatrix->Sample (m_roadGrid->GetPosition (place, place.offset), place.heading, place.turn, true,
+                                   v.rng.GetValue (0, 3), v.entry);
+    }
+  return v.alias.Sample (v.rng.GetValue (0, 3));
+}
+
+} // namespace ns3
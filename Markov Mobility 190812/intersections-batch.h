@@ -0,0 +1,194 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef INTERSECTIONS_BATCH_H
+#define INTERSECTIONS_BATCH_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/vector.h"
+#include "ns3/rectangle.h"
+#include "road-grid.h"
+#include "turn-pool.h"
+#include "turn-matrix.h"
+#include "trajectory-trace.h"
+#include "philox.h"
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Generates Markov intersection trajectories offline, on several threads.
+ *
+ * Vehicles of the Markov intersection model never interact, so each one
+ * is driven on its own, from its start position to the end of the run,
+ * without the simulator. The walk is the one of IntersectionsFleet, through
+ * the same RoadGrid steps, with the steps on which nothing happens skipped
+ * as in the EventDriven mode of Intersections: the speed is drawn again
+ * after each turn, lane change or rebound rather than on every step, which
+ * only makes a difference when MinSpeed and MaxSpeed differ.
+ *
+ * Every vehicle draws from its own PhiloxStream, keyed by Seed and its
+ * index, and keeps its Markov counters to itself, so the trajectories do
+ * not depend on the number of threads or on which thread drove which
+ * vehicle. They do differ from those of Intersections and
+ * IntersectionsFleet, which draw from the same kind of streams but
+ * in another order.
+ *
+ * Only the waypoints where a vehicle changes course are output, like
+ * the course changes of IntersectionsFleet.
+ */
+class IntersectionsBatch : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  IntersectionsBatch ();
+  virtual ~IntersectionsBatch ();
+
+  /** A piece of trajectory: from time on, the vehicle moves from position at velocity. */
+  struct Segment
+  {
+    double time;      //!< start of the segment, in seconds
+    Vector position;  //!< position at the start
+    Vector velocity;  //!< velocity until the next segment
+  };
+
+  /**
+   * \param roadGrid the road layout to drive on
+   */
+  void SetRoadGrid (Ptr<RoadGrid> roadGrid);
+  /**
+   * \return the road layout
+   */
+  Ptr<RoadGrid> GetRoadGrid (void) const;
+
+  /**
+   * \param position the start position of a new vehicle, inside the road grid
+   * \return the index of the vehicle
+   */
+  uint32_t Add (const Vector &position);
+  /**
+   * \return the number of vehicles
+   */
+  uint32_t GetN (void) const;
+
+  /**
+   * \brief Drive every vehicle and record its waypoints in a trace
+   *
+   * \param duration the time to drive for
+   * \param writer the writer to add the waypoints to, with the vehicle indices
+   */
+  void Run (Time duration, TrajectoryTraceWriter &writer) const;
+  /**
+   * \brief Drive every vehicle and keep its segments in memory
+   *
+   * \param duration the time to drive for
+   * \param segments set to the segments of each vehicle, in time order
+   */
+  void Run (Time duration, std::vector<std::vector<Segment> > &segments) const;
+  /**
+   * \return the number of threads used by the last Run
+   */
+  uint32_t GetThreads (void) const;
+
+private:
+  /** The state of a vehicle while it is driven. */
+  struct Vehicle
+  {
+    /**
+     * \param seed the seed of the run
+     * \param index the index of the vehicle
+     */
+    Vehicle (uint64_t seed, uint32_t index);
+
+    PhiloxStream rng;     //!< the random stream of the vehicle
+    RoadGrid::Place place; //!< where the vehicle is
+    double velocity;      //!< speed
+    double deltaSpeed;    //!< speed offset
+    uint32_t entry;       //!< TurnMatrix entry of the next turn
+    uint32_t p[3];        //!< straight, right and left counts
+    TurnAlias alias;      //!< distribution of the next turn, from p
+  };
+
+  /** The vehicles a Run drives and what it outputs, shared by its threads. */
+  struct Job
+  {
+    const IntersectionsBatch *batch;            //!< the batch
+    uint64_t steps;                             //!< number of steps to drive
+    TrajectoryTraceWriter *writer;              //!< writer, or 0
+    std::vector<std::vector<Segment> > *segments; //!< segment table, or 0
+  };
+
+  virtual void DoDispose (void);
+
+  /**
+   * \param duration the time to drive for
+   * \param writer the writer to add the waypoints to, or 0
+   * \param segments the segment table to fill, or 0
+   */
+  void DoRun (Time duration, TrajectoryTraceWriter *writer, std::vector<std::vector<Segment> > *segments) const;
+  /**
+   * Drive the vehicles [begin, end) of a Job.
+   */
+  static void RunRange (void *job, uint32_t begin, uint32_t end);
+  /**
+   * \param i the index of a vehicle
+   * \param steps the number of steps to drive it for
+   * \param segments set to its segments
+   */
+  void Drive (uint32_t i, uint64_t steps, std::vector<Segment> &segments) const;
+
+  /**
+   * Draw the start state of a vehicle, like IntersectionsFleet::Add.
+   */
+  void Start (Vehicle &v, const Vector &position) const;
+  /**
+   * Turn at the end of a walk step, like IntersectionsFleet::Turn.
+   * \param v a vehicle
+   * \param next the offset along its road at the end of the step
+   */
+  void Turn (Vehicle &v, double next) const;
+  /**
+   * \param v a vehicle
+   * \return its velocity
+   */
+  Vector GetVelocity (const Vehicle &v) const;
+  /** \return a new speed, with the turn encoded like IntersectionsFleet::DrawSpeed */
+  double DrawSpeed (Vehicle &v) const;
+  /** \return the turn at the next intersection, from the TurnMatrix or the counters */
+  uint8_t DrawDirection (Vehicle &v) const;
+
+  Ptr<RoadGrid> m_roadGrid; //!< road layout
+  Ptr<TurnMatrix> m_turnMatrix; //!< turning ratios by intersection, used instead of the counters if set
+  Rectangle m_bounds; //!< bounds of the road layout
+  double m_minSpeed; //!< low end of the speeds
+  double m_maxSpeed; //!< high end of the speeds
+  double m_delta; //!< bound of the speed offsets
+  Time m_step; //!< duration of a walk step
+  uint64_t m_seed; //!< seed of the vehicle streams
+  uint32_t m_threads; //!< number of threads, 0 for all
+  uint32_t m_grain; //!< vehicles per chunk of work
+  mutable uint32_t m_lastThreads; //!< threads used by the last Run
+  std::vector<Vector> m_start; //!< start positions
+};
+
+} // namespace ns3
+
+#endif /* INTERSECTIONS_BATCH_H */
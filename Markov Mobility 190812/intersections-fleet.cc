@@ -0,0 +1,995 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "intersections-fleet.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/string.h"
+#include "ns3/pointer.h"
+#include "ns3/nstime.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/simulator.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("IntersectionsFleet");
+
+NS_OBJECT_ENSURE_REGISTERED (IntersectionsFleet);
+NS_OBJECT_ENSURE_REGISTERED (IntersectionsFleetMobilityModel);
+
+// a vehicle this close to its place in a queue has reached it
+static const double g_arrived = 0.5;
+
+/**
+ * \param speed a random variable
+ * \param min set to the low end of its values
+ * \param max set to their high end
+ * \return false if it is neither Constant nor Uniform, which a
+ *         PhiloxStream cannot draw for it
+ */
+static bool
+GetRange (Ptr<RandomVariableStream> speed, double &min, double &max)
+{
+  Ptr<ConstantRandomVariable> constant = DynamicCast<ConstantRandomVariable> (speed);
+  if (constant != 0)
+    {
+      min = max = constant->GetConstant ();
+      return true;
+    }
+  Ptr<UniformRandomVariable> uniform = DynamicCast<UniformRandomVariable> (speed);
+  if (uniform != 0)
+    {
+      min = uniform->GetMin ();
+      max = uniform->GetMax ();
+      return true;
+    }
+  min = max = 0;
+  return false;
+}
+
+TypeId
+IntersectionsFleet::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IntersectionsFleet")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<IntersectionsFleet> ()
+    .AddAttribute ("Speed", "A random variable used to pick the speed (m/s).",
+                   StringValue ("ns3::UniformRandomVariable[Min=16|Max=18]"),
+                   MakePointerAccessor (&IntersectionsFleet::m_speed),
+                   MakePointerChecker<RandomVariableStream> ())
+    .AddAttribute ("Seed", "The seed of the random streams of the vehicles, mixed with RngRun.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&IntersectionsFleet::m_seed),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("DeltaSpeed", "Delta value of speeds",
+                   DoubleValue (5.556),
+                   MakeDoubleAccessor (&IntersectionsFleet::m_delta),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("Step", "Duration of a walk step.",
+                   TimeValue (Seconds (0.1)),
+                   MakeTimeAccessor (&IntersectionsFleet::m_step),
+                   MakeTimeChecker ())
+    .AddAttribute ("RoadGrid", "The road layout to drive on.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsFleet::SetRoadGrid,
+                                        &IntersectionsFleet::GetRoadGrid),
+                   MakePointerChecker<RoadGrid> ())
+    .AddAttribute ("TurnPool",
+                   "The pool holding the Markov turn counters; by default the "
+                   "pool shared with Intersections.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsFleet::m_turnPool),
+                   MakePointerChecker<TurnPool> ())
+    .AddAttribute ("TurnMatrix",
+                   "If set, the turns are drawn from these turning ratios by "
+                   "intersection, approach and previous turn instead of from the "
+                   "Markov counters of the vehicles.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsFleet::m_turnMatrix),
+                   MakePointerChecker<TurnMatrix> ())
+    .AddAttribute ("TrafficSignals",
+                   "If set, vehicles stop and queue at the red lights of these signals.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsFleet::SetTrafficSignals,
+                                        &IntersectionsFleet::GetTrafficSignals),
+                   MakePointerChecker<TrafficSignals> ())
+    .AddAttribute ("CarFollowing",
+                   "If true, vehicles follow the vehicle ahead on their lane with the "
+                   "Intelligent Driver Model instead of driving through it.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&IntersectionsFleet::m_carFollowing),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxAcceleration", "Maximum acceleration with CarFollowing (m/s^2).",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&IntersectionsFleet::m_maxAcceleration),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("ComfortDeceleration", "Comfortable deceleration with CarFollowing (m/s^2).",
+                   DoubleValue (1.5),
+                   MakeDoubleAccessor (&IntersectionsFleet::m_comfortDeceleration),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("TimeHeadway", "Desired time gap to the vehicle ahead with CarFollowing.",
+                   TimeValue (Seconds (1.5)),
+                   MakeTimeAccessor (&IntersectionsFleet::m_headway),
+                   MakeTimeChecker ())
+    .AddAttribute ("MinGap", "Gap kept to the vehicle ahead when stopped, with CarFollowing (m).",
+                   DoubleValue (2.0),
+                   MakeDoubleAccessor (&IntersectionsFleet::m_minGap),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("VehicleLength", "Length of a vehicle, with CarFollowing (m).",
+                   DoubleValue (5.0),
+                   MakeDoubleAccessor (&IntersectionsFleet::m_length),
+                   MakeDoubleChecker<double> (0))
+    .AddTraceSource ("CourseChange",
+                     "The velocity of a vehicle changed or it was moved.",
+                     MakeTraceSourceAccessor (&IntersectionsFleet::m_courseChangeTrace),
+                     "ns3::IntersectionsFleet::CourseChangeCallback")
+  ;
+  return tid;
+}
+
+IntersectionsFleet::IntersectionsFleet ()
+  : m_minSpeed (0),
+    m_maxSpeed (0),
+    m_sharedSpeed (false),
+    m_stream (RngSeedManager::GetNextStreamIndex ())
+{
+}
+
+IntersectionsFleet::~IntersectionsFleet ()
+{
+}
+
+void
+IntersectionsFleet::DoDispose (void)
+{
+  m_event.Cancel ();
+  std::fill (m_models.begin (), m_models.end (), (IntersectionsFleetMobilityModel *) 0);
+  if (m_turnPool != 0)
+    {
+      m_turnPool->RemoveUsers (m_turns.size ());
+    }
+  m_turns.clear ();
+  m_turnSet.clear ();
+  m_rng.clear ();
+  if (m_signals != 0)
+    {
+      m_signals->TraceDisconnectWithoutContext ("PhaseChange", MakeCallback (&IntersectionsFleet::Release, this));
+    }
+  m_signals = 0;
+  m_turnPool = 0;
+  m_turnMatrix = 0;
+  m_roadGrid = 0;
+  Object::DoDispose ();
+}
+
+void
+IntersectionsFleet::SetRoadGrid (Ptr<RoadGrid> roadGrid)
+{
+  m_roadGrid = roadGrid;
+  if (m_roadGrid != 0)
+    {
+      NS_ABORT_MSG_IF (m_roadGrid->GetGrid () > 0x10000,
+                       "IntersectionsFleet: at most 65536 lanes each way");
+      m_bounds = m_roadGrid->GetBounds ();
+    }
+}
+
+Ptr<RoadGrid>
+IntersectionsFleet::GetRoadGrid (void) const
+{
+  return m_roadGrid;
+}
+
+void
+IntersectionsFleet::SetTrafficSignals (Ptr<TrafficSignals> signals)
+{
+  NS_ABORT_MSG_IF (std::find (m_action.begin (), m_action.end (), (uint8_t) WAIT) != m_action.end (),
+                   "IntersectionsFleet: vehicles are waiting at the TrafficSignals");
+  if (m_signals != 0)
+    {
+      m_signals->TraceDisconnectWithoutContext ("PhaseChange", MakeCallback (&IntersectionsFleet::Release, this));
+    }
+  m_signals = signals;
+  if (m_signals != 0)
+    {
+      m_signals->TraceConnectWithoutContext ("PhaseChange", MakeCallback (&IntersectionsFleet::Release, this));
+    }
+}
+
+Ptr<TrafficSignals>
+IntersectionsFleet::GetTrafficSignals (void) const
+{
+  return m_signals;
+}
+
+uint32_t
+IntersectionsFleet::Add (const Vector &position)
+{
+  NS_LOG_FUNCTION (this << position);
+  NS_ABORT_MSG_IF (m_roadGrid == 0, "IntersectionsFleet: no RoadGrid set");
+  NS_ASSERT (m_bounds.IsInside (position));
+
+  if (m_turnPool == 0 && m_turnMatrix == 0)
+    {
+      m_turnPool = TurnPool::GetDefault ();
+    }
+  if (m_place.empty ())
+    {
+      m_time = Simulator::Now ();
+      m_event = Simulator::Schedule (m_step, &IntersectionsFleet::Step, this);
+      m_sharedSpeed = !GetRange (m_speed, m_minSpeed, m_maxSpeed);
+    }
+  if (m_signals != 0)
+    {
+      if (m_signals->GetRoadGrid () == 0)
+        {
+          m_signals->SetRoadGrid (m_roadGrid);
+        }
+      NS_ABORT_MSG_IF (m_signals->GetRoadGrid ()->GetIntersection () != m_roadGrid->GetIntersection (),
+                       "IntersectionsFleet: the TrafficSignals are for another RoadGrid");
+      m_signals->Initialize ();
+    }
+
+  // same draws, in the same order, as Intersections::DoInitialize
+  RoadGrid::Place place;
+  m_roadGrid->Start (place, position);
+
+  uint32_t i = m_place.size ();
+  // RngRun selects the run, as for the ns-3 streams
+  PhiloxStream rng (m_seed ^ (RngSeedManager::GetRun () << 32), m_stream, i);
+  double deltaSpeed = rng.GetValue (-m_delta, m_delta);
+
+  uint32_t p1 = rng.GetValue (0, 100);
+  uint32_t p2 = rng.GetValue (0, 100 - p1);
+  uint32_t p3 = 100 - p1 - p2;
+
+  if (m_turnMatrix != 0)
+    {
+      // no turn taken yet: as if the vehicle had gone straight
+      uint32_t entry;
+      place.turn = m_turnMatrix->Sample (m_roadGrid->GetPosition (place, place.offset), place.heading, 0, false,
+                                         rng.GetValue (0, 3), entry);
+      m_turnSet.push_back (entry);
+    }
+  else
+    {
+      TurnCounts counts;
+      m_turnPool->Start (counts, p1, p2, p3);
+      place.turn = m_turnPool->Sample (counts, rng.GetValue (0, 3));
+      m_turns.push_back (counts);
+      m_turnPool->AddUsers (1);
+    }
+
+  m_place.push_back (place);
+  m_velocity.push_back (0);
+  m_deltaSpeed.push_back (deltaSpeed);
+  m_rng.push_back (rng);
+  m_action.push_back (WALK);
+  m_models.push_back (0);
+  m_desired.push_back (0);
+  m_moved.push_back (0);
+  m_leader.push_back (0xffffffff);
+  m_queueNext.push_back (0xffffffff);
+
+  // the first step runs at the drawn speed, the turn is encoded from the next one on
+  m_velocity[i] = DrawSpeedValue (i) + deltaSpeed;
+  m_desired[i] = m_velocity[i];
+  SetPosition (i, position);
+  return i;
+}
+
+uint32_t
+IntersectionsFleet::GetN (void) const
+{
+  return m_place.size ();
+}
+
+Vector
+IntersectionsFleet::GetPosition (uint32_t i) const
+{
+  const RoadGrid::Place &place = m_place[i];
+  double t = (Simulator::Now () - m_time).GetSeconds ();
+  double offset = place.offset + RoadGrid::GetSign (place.heading) * m_velocity[i] * t;
+  Vector position = m_roadGrid->GetPosition (place, offset);
+  position.x = std::min (m_bounds.xMax, std::max (m_bounds.xMin, position.x));
+  position.y = std::min (m_bounds.yMax, std::max (m_bounds.yMin, position.y));
+  return position;
+}
+
+void
+IntersectionsFleet::SetPosition (uint32_t i, const Vector &position)
+{
+  NS_ASSERT (m_bounds.IsInside (position));
+  // the arrays hold the state at the last step
+  RoadGrid::Place &place = m_place[i];
+  double t = (Simulator::Now () - m_time).GetSeconds ();
+  m_roadGrid->Locate (place, position);
+  place.offset -= RoadGrid::GetSign (place.heading) * m_velocity[i] * t;
+  if (m_action[i] != WAIT)
+    {
+      Decide (i);
+    }
+  m_courseChangeTrace (i);
+}
+
+Vector
+IntersectionsFleet::GetVelocity (uint32_t i) const
+{
+  uint8_t heading = m_place[i].heading;
+  double v = RoadGrid::GetSign (heading) * m_velocity[i];
+  return heading < 2 ? Vector (0, v, 0) : Vector (v, 0, 0);
+}
+
+uint8_t
+IntersectionsFleet::GetHeading (uint32_t i) const
+{
+  return m_place[i].heading;
+}
+
+int
+IntersectionsFleet::GetDirection (uint32_t i) const
+{
+  return m_place[i].turn;
+}
+
+Vector
+IntersectionsFleet::GetProbability (uint32_t i) const
+{
+  if (m_turnMatrix != 0)
+    {
+      return m_turnMatrix->GetProbability (m_turnSet[i]);
+    }
+  return TurnPool::GetProbability (m_turns[i]);
+}
+
+uint32_t
+IntersectionsFleet::GetLeader (uint32_t i) const
+{
+  return m_leader[i] < m_place.size () ? m_leader[i] : m_place.size ();
+}
+
+Time
+IntersectionsFleet::GetStep (void) const
+{
+  return m_step;
+}
+
+void
+IntersectionsFleet::Step (void)
+{
+  Advance ();
+  for (std::vector<uint32_t>::const_iterator it = m_changed.begin (); it != m_changed.end (); ++it)
+    {
+      m_courseChangeTrace (*it);
+      if (m_models[*it] != 0)
+        {
+          m_models[*it]->NotifyCourseChange ();
+        }
+    }
+  m_event = Simulator::Schedule (m_step, &IntersectionsFleet::Step, this);
+}
+
+void
+IntersectionsFleet::Advance (void)
+{
+  m_time += m_step;
+  m_changed.clear ();
+  uint32_t n = m_place.size ();
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double distance;
+      if (m_action[i] == STOP && !GetStop (i, distance))
+        {
+          // the light turned green since the stop was decided
+          Decide (i);
+        }
+      bool changed = true;
+      switch (m_action[i])
+        {
+        case WALK:
+          changed = Walk (i);
+          break;
+        case TURN:
+          Turn (i);
+          break;
+        case LANE:
+          ChangeLane (i);
+          break;
+        case REBOUND:
+          Rebound (i);
+          break;
+        case STOP:
+          changed = Stop (i);
+          break;
+        case WAIT:
+          changed = false;
+          break;
+        }
+      if (m_carFollowing)
+        {
+          // the speeds are set once every vehicle has moved
+          m_moved[i] = changed;
+          continue;
+        }
+      if (m_action[i] != WAIT)
+        {
+          Decide (i);
+        }
+      if (changed || m_action[i] == STOP)
+        {
+          m_changed.push_back (i);
+        }
+    }
+
+  if (m_carFollowing)
+    {
+      Follow ();
+      for (uint32_t i = 0; i < n; i++)
+        {
+          if (m_action[i] != WAIT)
+            {
+              Decide (i);
+            }
+          if (m_moved[i] || m_action[i] == STOP)
+            {
+              m_changed.push_back (i);
+            }
+        }
+    }
+}
+
+uint32_t
+IntersectionsFleet::GetLane (const RoadGrid::Place &place) const
+{
+  int64_t n = m_roadGrid->GetIntersection ();
+  int64_t road = std::min (std::max ((int64_t) place.road, (int64_t) 0), n - 1);
+  return (place.heading * n + road) * m_roadGrid->GetGrid () + place.lane;
+}
+
+void
+IntersectionsFleet::Follow (void)
+{
+  uint32_t n = m_place.size ();
+  uint32_t lanes = 4 * m_roadGrid->GetIntersection () * m_roadGrid->GetGrid ();
+  double d = m_roadGrid->GetDistance ();
+  m_laneOf.resize (n);
+  m_arc.resize (n);
+  m_laneStart.assign (lanes + 1, 0);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      const RoadGrid::Place &place = m_place[i];
+      m_laneOf[i] = GetLane (place);
+      m_arc[i] = RoadGrid::GetSign (place.heading) * (place.block * d + place.offset);
+      m_laneStart[m_laneOf[i] + 1]++;
+    }
+  for (uint32_t l = 0; l < lanes; l++)
+    {
+      m_laneStart[l + 1] += m_laneStart[l];
+    }
+
+  // a stable counting sort from the order of the last step: vehicles
+  // rarely overtake, so each lane comes out nearly sorted
+  for (uint32_t i = m_laneOrder.size (); i < n; i++)
+    {
+      m_laneOrder.push_back (i);
+    }
+  m_sorted.resize (n);
+  for (uint32_t k = 0; k < n; k++)
+    {
+      uint32_t i = m_laneOrder[k];
+      m_sorted[m_laneStart[m_laneOf[i]]++] = i;
+    }
+  m_laneOrder.swap (m_sorted);
+  // each start moved up to the start of the next lane
+  for (uint32_t l = lanes; l > 0; l--)
+    {
+      m_laneStart[l] = m_laneStart[l - 1];
+    }
+  m_laneStart[0] = 0;
+
+  for (uint32_t l = 0; l < lanes; l++)
+    {
+      uint32_t begin = m_laneStart[l];
+      uint32_t end = m_laneStart[l + 1];
+      for (uint32_t k = begin + 1; k < end; k++)
+        {
+          uint32_t i = m_laneOrder[k];
+          uint32_t j = k;
+          for (; j > begin && m_arc[m_laneOrder[j - 1]] > m_arc[i]; j--)
+            {
+              m_laneOrder[j] = m_laneOrder[j - 1];
+            }
+          m_laneOrder[j] = i;
+        }
+    }
+
+  double h = m_step.GetSeconds ();
+  double headway = m_headway.GetSeconds ();
+  double root = 2 * std::sqrt (m_maxAcceleration * m_comfortDeceleration);
+  for (uint32_t l = 0; l < lanes; l++)
+    {
+      uint32_t end = m_laneStart[l + 1];
+      for (uint32_t k = m_laneStart[l]; k < end; k++)
+        {
+          uint32_t i = m_laneOrder[k];
+          uint32_t leader = 0xffffffff;
+          double gap = 0;
+          if (k + 1 < end)
+            {
+              leader = m_laneOrder[k + 1];
+              gap = m_arc[leader] - m_arc[i] - m_length;
+            }
+          else
+            {
+              GetReboundLeader (i, leader, gap);
+            }
+          m_leader[i] = leader;
+          if (m_action[i] == WAIT)
+            {
+              continue;
+            }
+
+          double v = m_velocity[i];
+          double free = v / m_desired[i];
+          double interaction = 0;
+          if (leader != 0xffffffff)
+            {
+              gap = std::max (gap, 0.1);
+              double desired = m_minGap + std::max (v * headway + v * (v - m_velocity[leader]) / root, 0.0);
+              interaction = (desired / gap) * (desired / gap);
+            }
+          double distance;
+          if (GetStop (i, distance))
+            {
+              // brake for the place in the queue as for a vehicle standing ahead of it
+              double stop = std::max (distance + m_minGap, 0.1);
+              double desired = m_minGap + v * headway + v * v / root;
+              interaction = std::max (interaction, (desired / stop) * (desired / stop));
+            }
+          double acceleration = 1 - free * free * free * free - interaction;
+          double speed = std::max (v + m_maxAcceleration * acceleration * h, 0.0);
+          if (speed != v)
+            {
+              m_velocity[i] = speed;
+              m_moved[i] = true;
+            }
+        }
+    }
+}
+
+void
+IntersectionsFleet::GetReboundLeader (uint32_t i, uint32_t &leader, double &gap) const
+{
+  const RoadGrid::Place &place = m_place[i];
+  bool vertical = place.heading < 2;
+  bool positive = RoadGrid::GetSign (place.heading) > 0;
+  double offset;
+  int64_t block = place.block + m_roadGrid->GetBlock (place.offset, offset);
+  int64_t last = positive ? m_roadGrid->GetIntersection () - 1 : 0;
+  // only a vehicle that cannot turn any more before the boundary
+  if (block != last || (place.approach && place.turn != 0))
+    {
+      return;
+    }
+  double a;
+  if (vertical)
+    {
+      a = positive ? m_bounds.yMax : m_bounds.yMin;
+    }
+  else
+    {
+      a = positive ? m_bounds.xMax : m_bounds.xMin;
+    }
+  double edge = RoadGrid::GetSign (place.heading) * a;
+  RoadGrid::Place back = place;
+  m_roadGrid->Rebound (back, a - place.block * m_roadGrid->GetDistance (), m_bounds);
+  uint32_t lane = GetLane (back);
+  if (m_laneStart[lane] == m_laneStart[lane + 1])
+    {
+      return;
+    }
+  // the last vehicle of the lane the vehicle comes back on
+  leader = m_laneOrder[m_laneStart[lane]];
+  gap = (edge - m_arc[i]) + (m_arc[leader] + edge) - m_length;
+}
+
+void
+IntersectionsFleet::Decide (uint32_t i)
+{
+  const RoadGrid::Place &place = m_place[i];
+  double h = m_step.GetSeconds ();
+  double v = m_velocity[i];
+  double next = place.offset + RoadGrid::GetSign (place.heading) * v * h;
+  RoadGrid::Step step = m_roadGrid->GetStep (place, place.offset, next, m_bounds);
+  if (step != RoadGrid::REBOUND && place.approach)
+    {
+      // with CarFollowing, a vehicle can slow down short of the block edge
+      // it was to cross: it is not at the next intersection yet
+      bool positive = RoadGrid::GetSign (place.heading) > 0;
+      double r = GetOffset (place.offset);
+      if (positive ? r > m_roadGrid->GetLines ().edgeHigh : r < m_roadGrid->GetLines ().edgeLow)
+        {
+          m_action[i] = WALK;
+          return;
+        }
+      double distance;
+      if (GetStop (i, distance) && distance - v * h <= g_arrived)
+        {
+          // slow down to reach the place in the queue at the end of the step
+          m_velocity[i] = std::min (v, std::max (distance, 0.0) / h);
+          m_action[i] = STOP;
+          return;
+        }
+    }
+  // the first actions are numbered like the steps of the walk
+  m_action[i] = step;
+}
+
+bool
+IntersectionsFleet::Walk (uint32_t i)
+{
+  RoadGrid::Place &place = m_place[i];
+  double offset = place.offset + RoadGrid::GetSign (place.heading) * m_velocity[i] * m_step.GetSeconds ();
+  place.block += m_roadGrid->GetBlock (offset, place.offset);
+  return SetSpeed (i, DrawSpeed (i));
+}
+
+void
+IntersectionsFleet::Turn (uint32_t i)
+{
+  RoadGrid::Place &place = m_place[i];
+  if (m_turnMatrix == 0)
+    {
+      m_turnPool->Count (m_turns[i], place.turn);
+    }
+  // the vehicle is still where it was when the turn was decided
+  double next = place.offset + RoadGrid::GetSign (place.heading) * m_velocity[i] * m_step.GetSeconds ();
+  m_roadGrid->Turn (place, place.offset, next);
+  place.turn = DrawDirection (i);
+  SetSpeed (i, DrawSpeed (i));
+}
+
+void
+IntersectionsFleet::ChangeLane (uint32_t i)
+{
+  RoadGrid::Place &place = m_place[i];
+  m_roadGrid->ChangeLane (place, place.offset);
+}
+
+void
+IntersectionsFleet::Rebound (uint32_t i)
+{
+  RoadGrid::Place &place = m_place[i];
+  double next = place.offset + RoadGrid::GetSign (place.heading) * m_velocity[i] * m_step.GetSeconds ();
+  m_roadGrid->Rebound (place, next, m_bounds);
+}
+
+bool
+IntersectionsFleet::Stop (uint32_t i)
+{
+  double distance;
+  GetStop (i, distance);
+  // a vehicle already past its place stays where it is
+  RoadGrid::Place &place = m_place[i];
+  double offset = place.offset + RoadGrid::GetSign (place.heading) * std::max (distance, 0.0);
+  place.block += m_roadGrid->GetBlock (offset, place.offset);
+  bool changed = m_velocity[i] != 0;
+  m_velocity[i] = 0;
+  m_action[i] = WAIT;
+
+  if (m_queueHead.empty ())
+    {
+      uint32_t n = m_roadGrid->GetIntersection ();
+      uint32_t queues = 4 * n * m_roadGrid->GetGrid () * n;
+      m_queueHead.assign (queues, 0xffffffff);
+      m_queueTail.assign (queues, 0xffffffff);
+      m_queueSize.assign (queues, 0);
+    }
+  uint32_t q = GetQueue (i);
+  if (m_queueSize[q]++ == 0)
+    {
+      m_queueHead[q] = i;
+    }
+  else
+    {
+      m_queueNext[m_queueTail[q]] = i;
+    }
+  m_queueTail[q] = i;
+  m_queueNext[i] = 0xffffffff;
+  return changed;
+}
+
+void
+IntersectionsFleet::Release (uint32_t intersection, uint8_t green)
+{
+  NS_LOG_FUNCTION (this << intersection << (uint32_t) green);
+  if (m_queueHead.empty ())
+    {
+      return;
+    }
+  uint32_t n = m_roadGrid->GetIntersection ();
+  uint32_t grid = m_roadGrid->GetGrid ();
+  uint32_t column = intersection % n;
+  uint32_t row = intersection / n;
+  // the arrays hold the state at the last step
+  double t = (Simulator::Now () - m_time).GetSeconds ();
+  for (uint8_t heading = 0; heading < 4; heading++)
+    {
+      if (!((green >> heading) & 1))
+        {
+          continue;
+        }
+      uint32_t road = heading < 2 ? column : row;
+      uint32_t block = heading < 2 ? row : column;
+      for (uint32_t lane = 0; lane < grid; lane++)
+        {
+          uint32_t q = ((heading * n + road) * grid + lane) * n + block;
+          for (uint32_t i = m_queueHead[q]; i != 0xffffffff; i = m_queueNext[i])
+            {
+              m_action[i] = WALK;
+              if (m_carFollowing)
+                {
+                  // Follow speeds them up from the next step on
+                  Decide (i);
+                  continue;
+                }
+              double v = DrawSpeed (i);
+              m_velocity[i] = v;
+              m_place[i].offset -= RoadGrid::GetSign (heading) * v * t;
+              Decide (i);
+              m_courseChangeTrace (i);
+              if (m_models[i] != 0)
+                {
+                  m_models[i]->NotifyCourseChange ();
+                }
+            }
+          m_queueHead[q] = 0xffffffff;
+          m_queueTail[q] = 0xffffffff;
+          m_queueSize[q] = 0;
+        }
+    }
+}
+
+bool
+IntersectionsFleet::GetStop (uint32_t i, double &distance) const
+{
+  const RoadGrid::Place &place = m_place[i];
+  if (m_signals == 0 || !place.approach)
+    {
+      return false;
+    }
+  uint8_t heading = place.heading;
+  bool vertical = heading < 2;
+  bool positive = RoadGrid::GetSign (heading) > 0;
+  double offset;
+  int64_t block = place.block + m_roadGrid->GetBlock (place.offset, offset);
+  double line = positive ? m_roadGrid->GetLines ().edgeLow : m_roadGrid->GetLines ().edgeHigh;
+  if (positive ? offset > line : offset < line)
+    {
+      // already in the intersection
+      return false;
+    }
+  int64_t last = m_roadGrid->GetIntersection () - 1;
+  int64_t road = place.road;
+  block = std::min (std::max (block, (int64_t) 0), last);
+  road = std::min (std::max (road, (int64_t) 0), last);
+  if (m_signals->IsGreen (vertical ? road : block, vertical ? block : road, heading))
+    {
+      return false;
+    }
+  double queue = m_queueSize.empty () ? 0 : m_queueSize[GetQueue (i)] * (m_length + m_minGap);
+  distance = positive ? line - queue - offset : offset - line - queue;
+  return true;
+}
+
+uint32_t
+IntersectionsFleet::GetQueue (uint32_t i) const
+{
+  const RoadGrid::Place &place = m_place[i];
+  double offset;
+  int64_t block = place.block + m_roadGrid->GetBlock (place.offset, offset);
+  int64_t last = m_roadGrid->GetIntersection () - 1;
+  block = std::min (std::max (block, (int64_t) 0), last);
+  return GetLane (place) * (last + 1) + block;
+}
+
+double
+IntersectionsFleet::DrawSpeedValue (uint32_t i)
+{
+  if (m_sharedSpeed)
+    {
+      return m_speed->GetValue ();
+    }
+  // a constant speed takes nothing from the stream
+  if (m_minSpeed == m_maxSpeed)
+    {
+      return m_minSpeed;
+    }
+  return m_rng[i].GetValue (m_minSpeed, m_maxSpeed);
+}
+
+double
+IntersectionsFleet::DrawSpeed (uint32_t i)
+{
+  double speed = DrawSpeedValue (i) + m_deltaSpeed[i];
+  int x1 = speed * 1000;
+  int x2 = x1 / 10;
+  return speed - (x1-x2*10)*0.001 + m_place[i].turn*0.001;
+}
+
+bool
+IntersectionsFleet::SetSpeed (uint32_t i, double speed)
+{
+  if (m_carFollowing)
+    {
+      // Follow sets the actual speed
+      m_desired[i] = speed;
+      return false;
+    }
+  double v = m_velocity[i];
+  m_velocity[i] = speed;
+  return speed != v;
+}
+
+uint8_t
+IntersectionsFleet::DrawDirection (uint32_t i)
+{
+  if (m_turnMatrix != 0)
+    {
+      // the place still holds the turn just taken
+      const RoadGrid::Place &place = m_place[i];
+      return m_turnMatrix->Sample (m_roadGrid->GetPosition (place, place.offset), place.heading, place.turn, true,
+                                   m_rng[i].GetValue (0, 3), m_turnSet[i]);
+    }
+  return m_turnPool->Sample (m_turns[i], m_rng[i].GetValue (0, 3));
+}
+
+double
+IntersectionsFleet::GetOffset (double a) const
+{
+  double offset;
+  m_roadGrid->GetBlock (a, offset);
+  return offset;
+}
+
+void
+IntersectionsFleet::SetModel (uint32_t i, IntersectionsFleetMobilityModel *model)
+{
+  m_models[i] = model;
+}
+
+int64_t
+IntersectionsFleet::AssignStreams (int64_t stream)
+{
+  m_stream = stream;
+  // a Speed neither Constant nor Uniform draws from its own stream
+  m_speed->SetStream (stream);
+  return 1;
+}
+
+
+TypeId
+IntersectionsFleetMobilityModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IntersectionsFleetMobilityModel")
+    .SetParent<MobilityModel> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<IntersectionsFleetMobilityModel> ()
+    .AddAttribute ("Fleet", "The fleet the vehicle belongs to.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsFleetMobilityModel::m_fleet),
+                   MakePointerChecker<IntersectionsFleet> ())
+  ;
+  return tid;
+}
+
+IntersectionsFleetMobilityModel::IntersectionsFleetMobilityModel ()
+  : m_index (0),
+    m_added (false)
+{
+}
+
+Ptr<IntersectionsFleet>
+IntersectionsFleetMobilityModel::GetFleet (void) const
+{
+  return m_fleet;
+}
+
+uint32_t
+IntersectionsFleetMobilityModel::GetIndex (void) const
+{
+  return m_index;
+}
+
+Vector
+IntersectionsFleetMobilityModel::GetProbability (void) const
+{
+  return m_fleet->GetProbability (m_index);
+}
+
+int
+IntersectionsFleetMobilityModel::GetDirection (void) const
+{
+  return m_fleet->GetDirection (m_index);
+}
+
+void
+IntersectionsFleetMobilityModel::DoInitialize (void)
+{
+  NS_ABORT_MSG_IF (m_fleet == 0, "IntersectionsFleetMobilityModel: no Fleet set");
+  m_index = m_fleet->Add (m_position);
+  m_fleet->SetModel (m_index, this);
+  m_added = true;
+  NotifyCourseChange ();
+  MobilityModel::DoInitialize ();
+}
+
+void
+IntersectionsFleetMobilityModel::DoDispose (void)
+{
+  if (m_added)
+    {
+      // the vehicle stays in the fleet, nobody listens to it any more
+      m_fleet->SetModel (m_index, 0);
+    }
+  m_fleet = 0;
+  MobilityModel::DoDispose ();
+}
+
+Vector
+IntersectionsFleetMobilityModel::DoGetPosition (void) const
+{
+  return m_added ? m_fleet->GetPosition (m_index) : m_position;
+}
+
+void
+IntersectionsFleetMobilityModel::DoSetPosition (const Vector &position)
+{
+  if (m_added)
+    {
+      m_fleet->SetPosition (m_index, position);
+      NotifyCourseChange ();
+    }
+  else
+    {
+      m_position = position;
+    }
+}
+
+Vector
+IntersectionsFleetMobilityModel::DoGetVelocity (void) const
+{
+  return m_added ? m_fleet->GetVelocity (m_index) : Vector ();
+}
+
+uint8_t
+IntersectionsFleetMobilityModel::DoGetDirection (void) const
+{
+  return m_added ? m_fleet->GetHeading (m_index) : 0;
+}
+
+void
+IntersectionsFleetMobilityModel::DoSetDirection (const uint8_t)
+{
+}
+
+} // namespace ns3
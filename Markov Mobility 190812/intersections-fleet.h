@@ -0,0 +1,400 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef INTERSECTIONS_FLEET_H
+#define INTERSECTIONS_FLEET_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/rectangle.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
+#include "mobility-model.h"
+#include "road-grid.h"
+#include "turn-pool.h"
+#include "turn-matrix.h"
+#include "philox.h"
+#include "traffic-signals.h"
+#include <vector>
+
+namespace ns3 {
+
+class IntersectionsFleetMobilityModel;
+
+/**
+ * \ingroup mobility
+ * \brief Markov intersection mobility for a whole fleet of vehicles.
+ *
+ * Drives the same walk as Intersections, through the same RoadGrid
+ * steps, but keeps the state of every vehicle in contiguous arrays and moves all of them from a single event
+ * every Step, instead of one event per vehicle per step. Nodes see the
+ * fleet through IntersectionsFleetMobilityModel.
+ *
+ * Vehicle i draws from substream i of the PhiloxStream keyed by Seed, RngRun
+ * and the stream of the fleet, so a fleet of one vehicle draws like an
+ * Intersections model given the same Seed and stream.
+ *
+ * A CourseChange is only notified when the velocity of a vehicle changes
+ * or it jumps to another lane, not on every step; the fleet itself reports
+ * the same changes through its own CourseChange trace source.
+ *
+ * With CarFollowing, vehicles no longer drive through each other: the
+ * speed drawn on each step becomes the desired speed of the Intelligent
+ * Driver Model, and the actual speed follows from the gap to the vehicle
+ * ahead on the same lane. Every step, the vehicles are sorted by lane and
+ * by position along it, starting from the order of the previous step so
+ * the sort is linear, and each vehicle looks up its leader as the next
+ * one in its lane. The speed then no longer encodes the next turn.
+ *
+ * With TrafficSignals, a vehicle heading for a red light stops at the
+ * stop line, or behind the vehicles already waiting on its lane, and
+ * joins the queue of that lane. The queue is released as a whole when
+ * the light turns green, from the phase change event of the signals; the
+ * waiting vehicles are not stepped. Queued vehicles stand VehicleLength +
+ * MinGap apart, with or without CarFollowing; with CarFollowing, the
+ * vehicles also brake for the stop line as for a vehicle standing there.
+ */
+class IntersectionsFleet : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  IntersectionsFleet ();
+  virtual ~IntersectionsFleet ();
+
+  /**
+   * \param roadGrid the road layout to drive on
+   */
+  void SetRoadGrid (Ptr<RoadGrid> roadGrid);
+  /**
+   * \return the road layout
+   */
+  Ptr<RoadGrid> GetRoadGrid (void) const;
+  /**
+   * \param signals the traffic lights to stop at, or 0 for none
+   */
+  void SetTrafficSignals (Ptr<TrafficSignals> signals);
+  /**
+   * \return the traffic lights
+   */
+  Ptr<TrafficSignals> GetTrafficSignals (void) const;
+
+  /**
+   * \brief Add a vehicle to the fleet
+   *
+   * Picks the heading, lane, speed offset and Markov counters the way
+   * Intersections::DoInitialize does, from the substream of the vehicle,
+   * and starts the fleet event if this is the first vehicle.
+   *
+   * \param position the position of the vehicle, inside the road grid
+   * \return the index of the vehicle
+   */
+  uint32_t Add (const Vector &position);
+  /**
+   * \return the number of vehicles in the fleet
+   */
+  uint32_t GetN (void) const;
+
+  /**
+   * \param i the index of a vehicle
+   * \return its current position
+   */
+  Vector GetPosition (uint32_t i) const;
+  /**
+   * Move a vehicle; it keeps its heading and speed, and a vehicle waiting
+   * at a red light keeps waiting for its queue.
+   *
+   * \param i the index of a vehicle
+   * \param position its new position, inside the road grid
+   */
+  void SetPosition (uint32_t i, const Vector &position);
+  /**
+   * \param i the index of a vehicle
+   * \return its current velocity
+   */
+  Vector GetVelocity (uint32_t i) const;
+  /**
+   * \param i the index of a vehicle
+   * \return its heading, numbered like RoadGrid::Place::heading
+   */
+  uint8_t GetHeading (uint32_t i) const;
+  /**
+   * \param i the index of a vehicle
+   * \return the turn it takes at the next intersection, like Intersections::GetDirection
+   */
+  int GetDirection (uint32_t i) const;
+  /**
+   * \param i the index of a vehicle
+   * \return its straight, right and left percentages, like Intersections::GetProbability
+   */
+  Vector GetProbability (uint32_t i) const;
+  /**
+   * \param i the index of a vehicle
+   * \return the vehicle ahead of it on its lane, or on the lane it comes
+   *         back on after a rebound, at the last step with CarFollowing;
+   *         GetN () if there is none
+   */
+  uint32_t GetLeader (uint32_t i) const;
+
+  /**
+   * \return the duration of one walk step
+   */
+  Time GetStep (void) const;
+
+  /**
+   * Vehicle i draws from substream i of the stream; the vehicles added
+   * before keep theirs.
+   *
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned
+   */
+  int64_t AssignStreams (int64_t stream);
+
+  /**
+   * TracedCallback signature for the course changes of the vehicles.
+   *
+   * \param [in] vehicle The index of the vehicle.
+   */
+  typedef void (* CourseChangeCallback)(uint32_t vehicle);
+
+private:
+  friend class IntersectionsFleetMobilityModel;
+
+  /**
+   * What a vehicle does on its next step, decided at the end of the
+   * current one; the first four are numbered like RoadGrid::Step.
+   */
+  enum Action
+  {
+    WALK,     //!< move on, as Intersections::DoInitializePrivate
+    TURN,     //!< turn at the intersection, see RoadGrid::Turn
+    LANE,     //!< move to the turn lane, see RoadGrid::ChangeLane
+    REBOUND,  //!< turn back at the boundary, see RoadGrid::Rebound
+    STOP,     //!< stop at a red light and join the queue of the lane
+    WAIT      //!< wait in a queue until the light turns green
+  };
+
+  virtual void DoDispose (void);
+
+  /**
+   * Advance the fleet and schedule the next step.
+   */
+  void Step (void);
+  /**
+   * \brief Move every vehicle by one step
+   *
+   * The vehicles that changed course are left in m_changed for Step to
+   * report; the positions are still taken against Simulator::Now ().
+   */
+  void Advance (void);
+  /**
+   * \param i the index of a vehicle
+   * \param model the model to notify of its course changes, or 0
+   */
+  void SetModel (uint32_t i, IntersectionsFleetMobilityModel *model);
+
+  /**
+   * Decide the action of the next step from the current state of a vehicle.
+   * \param i the index of a vehicle
+   */
+  void Decide (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   * \return true if its speed changed
+   */
+  bool Walk (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   */
+  void Turn (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   */
+  void ChangeLane (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   */
+  void Rebound (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   * \return true if its velocity changed
+   */
+  bool Stop (uint32_t i);
+  /**
+   * Release the queues of the approaches that just turned green.
+   *
+   * \param intersection the index of the intersection, as in TrafficSignals
+   * \param green the headings that may enter it
+   */
+  void Release (uint32_t intersection, uint8_t green);
+  /**
+   * \param i the index of a vehicle
+   * \param distance set to the distance to its place in the queue of its
+   *        lane, negative if it is already past it
+   * \return true if it has to stop at the light ahead of it
+   */
+  bool GetStop (uint32_t i, double &distance) const;
+  /**
+   * \param i the index of a vehicle heading for an intersection
+   * \return the queue of its lane at that intersection
+   */
+  uint32_t GetQueue (uint32_t i) const;
+  /**
+   * \param i the index of a vehicle
+   * \return a speed drawn from Speed for it, without its offset
+   */
+  double DrawSpeedValue (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   * \return a new speed, with the turn encoded in its third decimal like Intersections::InputVelocity
+   */
+  double DrawSpeed (uint32_t i);
+  /**
+   * \param i the index of a vehicle
+   * \param speed a speed drawn for it
+   * \return true if its velocity changed
+   */
+  bool SetSpeed (uint32_t i, double speed);
+  /**
+   * Sort the vehicles by lane, find their leaders and set their speeds
+   * with the Intelligent Driver Model.
+   */
+  void Follow (void);
+  /**
+   * \param place where a vehicle is
+   * \return the lane it drives on, by heading, road and lane
+   */
+  uint32_t GetLane (const RoadGrid::Place &place) const;
+  /**
+   * Find what the first vehicle of a lane follows once it rebounds, if
+   * nothing can take it off the lane before the boundary.
+   *
+   * \param i the index of the first vehicle of a lane
+   * \param leader set to the last vehicle of the lane it comes back on, if any
+   * \param gap set to the distance between the two along the rebound
+   */
+  void GetReboundLeader (uint32_t i, uint32_t &leader, double &gap) const;
+  /**
+   * \param i the index of a vehicle, at the intersection it just turned at
+   * \return the turn to take at the next intersection, drawn from the
+   *         TurnMatrix or else from its counters
+   */
+  uint8_t DrawDirection (uint32_t i);
+  /**
+   * \param a a coordinate
+   * \return its offset inside its block
+   */
+  double GetOffset (double a) const;
+
+  Ptr<RoadGrid> m_roadGrid; //!< road layout
+  Ptr<TurnPool> m_turnPool; //!< pool of the Markov turn counters
+  Ptr<TurnMatrix> m_turnMatrix; //!< turning ratios by intersection, used instead of the counters if set
+  Ptr<TrafficSignals> m_signals; //!< traffic lights, or 0
+  Rectangle m_bounds; //!< bounds of the road layout
+  Ptr<RandomVariableStream> m_speed; //!< rv for picking speed
+  double m_minSpeed; //!< low end of a Constant or Uniform speed, from the first Add on
+  double m_maxSpeed; //!< high end of a Constant or Uniform speed
+  bool m_sharedSpeed; //!< the speed is neither Constant nor Uniform: drawn from m_speed itself
+  uint64_t m_seed; //!< key of the random streams of the vehicles
+  uint64_t m_stream; //!< number of the stream the vehicles draw substreams of
+  double m_delta; //!< bound of the speed offsets
+  Time m_step; //!< duration of a walk step
+  Time m_time; //!< time of the state held in the arrays
+  bool m_carFollowing; //!< follow the vehicle ahead with the Intelligent Driver Model
+  double m_maxAcceleration; //!< IDM maximum acceleration
+  double m_comfortDeceleration; //!< IDM comfortable deceleration
+  Time m_headway; //!< IDM desired time headway
+  double m_minGap; //!< IDM minimum gap
+  double m_length; //!< length of a vehicle
+  EventId m_event; //!< the fleet step event
+
+  std::vector<RoadGrid::Place> m_place; //!< where the vehicles are at m_time, with their headings and next turns
+  std::vector<double> m_velocity; //!< speeds
+  std::vector<double> m_deltaSpeed; //!< speed offsets
+  std::vector<PhiloxStream> m_rng; //!< random streams of the vehicles
+  std::vector<uint8_t> m_action; //!< actions of the next step
+  std::vector<TurnCounts> m_turns; //!< Markov turn counters, without m_turnMatrix
+  std::vector<uint32_t> m_turnSet; //!< m_turnMatrix entries of the next turns
+  std::vector<double> m_desired; //!< desired speeds, with CarFollowing
+  std::vector<uint8_t> m_moved; //!< 1 if the course of the vehicle changed during the step, with CarFollowing
+  std::vector<uint32_t> m_laneOrder; //!< vehicles by lane and position along it, at the last step
+  std::vector<uint32_t> m_laneStart; //!< index in m_laneOrder of the first vehicle of each lane
+  std::vector<uint32_t> m_laneOf; //!< lane of each vehicle
+  std::vector<double> m_arc; //!< position of each vehicle along its direction of travel
+  std::vector<uint32_t> m_leader; //!< vehicle ahead on the same lane, or 0xffffffff
+  std::vector<uint32_t> m_sorted; //!< scratch for the lane sort
+  std::vector<uint32_t> m_queueNext; //!< vehicle behind in the same queue, or 0xffffffff
+  std::vector<uint32_t> m_queueHead; //!< first vehicle of each queue, by lane and intersection, or 0xffffffff
+  std::vector<uint32_t> m_queueTail; //!< last vehicle of each queue, or 0xffffffff
+  std::vector<uint32_t> m_queueSize; //!< number of vehicles in each queue
+  std::vector<IntersectionsFleetMobilityModel *> m_models; //!< models notified of course changes
+  std::vector<uint32_t> m_changed; //!< vehicles whose course changed during the last step
+  TracedCallback<uint32_t> m_courseChangeTrace; //!< course change of a vehicle
+};
+
+/**
+ * \ingroup mobility
+ * \brief Per-node view of a vehicle of an IntersectionsFleet.
+ *
+ * Holds no state of its own besides the index of the vehicle: the
+ * position set before initialization is handed to the fleet when the
+ * node is initialized. Random streams are assigned on the fleet.
+ */
+class IntersectionsFleetMobilityModel : public MobilityModel
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  IntersectionsFleetMobilityModel ();
+
+  /**
+   * \return the fleet the vehicle belongs to
+   */
+  Ptr<IntersectionsFleet> GetFleet (void) const;
+  /**
+   * \return the index of the vehicle in its fleet
+   */
+  uint32_t GetIndex (void) const;
+
+  Vector GetProbability (void) const;
+  int GetDirection (void) const;
+
+private:
+  friend class IntersectionsFleet;
+
+  virtual void DoDispose (void);
+  virtual void DoInitialize (void);
+  virtual Vector DoGetPosition (void) const;
+  virtual void DoSetPosition (const Vector &position);
+  virtual Vector DoGetVelocity (void) const;
+  virtual uint8_t DoGetDirection (void) const;
+  virtual void DoSetDirection (const uint8_t direction);
+
+  Ptr<IntersectionsFleet> m_fleet; //!< the fleet
+  uint32_t m_index; //!< index of the vehicle in the fleet
+  bool m_added; //!< true once the vehicle is in the fleet
+  Vector m_position; //!< position set before the vehicle was added
+};
+
+} // namespace ns3
+
+#endif /* INTERSECTIONS_FLEET_H */
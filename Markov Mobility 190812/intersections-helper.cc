@@ -0,0 +1,145 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "intersections-helper.h"
+#include "parallel-for.h"
+#include "ns3/node.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("IntersectionsHelper");
+
+IntersectionsHelper::IntersectionsHelper ()
+  : m_threads (0),
+    m_stream (-1)
+{
+  m_factory.SetTypeId ("ns3::Intersections");
+}
+
+void
+IntersectionsHelper::SetAttribute (std::string name, const AttributeValue &value)
+{
+  m_factory.Set (name, value);
+}
+
+void
+IntersectionsHelper::SetPositionAllocator (Ptr<PositionAllocator> allocator)
+{
+  m_position = allocator;
+}
+
+void
+IntersectionsHelper::SetThreads (uint32_t threads)
+{
+  m_threads = threads;
+}
+
+void
+IntersectionsHelper::SetStream (int64_t stream)
+{
+  m_stream = stream;
+}
+
+void
+IntersectionsHelper::Install (NodeContainer c) const
+{
+  NS_LOG_FUNCTION (this << c.GetN ());
+  NS_ABORT_MSG_IF (m_position == 0, "IntersectionsHelper: no position allocator set");
+  uint32_t n = c.GetN ();
+  if (n == 0)
+    {
+      return;
+    }
+
+  // everything the models share is set up once, on the prototype
+  Ptr<Intersections> prototype = m_factory.Create<Intersections> ();
+  prototype->CheckRoadGrid ();
+  Intersections::Config &config = prototype->GetOwnConfig ();
+  if (config.turnPool == 0 && config.turnMatrix == 0)
+    {
+      config.turnPool = TurnPool::GetDefault ();
+    }
+
+  std::vector<Vector> positions (n);
+  m_position->GetNextBatch (&positions[0], n);
+
+  // the automatic stream numbers come from a global counter, and
+  // aggregation is not thread safe either: copy on this thread
+  Job job;
+  job.models.resize (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Ptr<Node> node = c.Get (i);
+      NS_ABORT_MSG_IF (node->GetObject<MobilityModel> () != 0,
+                       "IntersectionsHelper: node " << i << " already has a mobility model");
+      NS_ABORT_MSG_IF (!config.bounds.IsInside (positions[i]),
+                       "IntersectionsHelper: position " << positions[i] << " out of the bounds");
+      Ptr<Intersections> model = prototype->Clone ();
+      // not SetPosition, which schedules a walk step that DoInitialize cancels
+      model->m_position = positions[i];
+      model->m_started = true;
+      if (m_stream >= 0)
+        {
+          model->AssignStreams (m_stream + i);
+        }
+      node->AggregateObject (model);
+      job.models[i] = model;
+    }
+  Draw (job);
+  if (config.turnMatrix == 0)
+    {
+      config.turnPool->AddUsers (n);
+    }
+}
+
+int64_t
+IntersectionsHelper::AssignStreams (NodeContainer c, int64_t stream) const
+{
+  NS_LOG_FUNCTION (this << c.GetN () << stream);
+  Job job;
+  job.models.resize (c.GetN ());
+  for (uint32_t i = 0; i < c.GetN (); i++)
+    {
+      Ptr<Intersections> model = c.Get (i)->GetObject<Intersections> ();
+      NS_ABORT_MSG_IF (model == 0 || !model->m_started,
+                       "IntersectionsHelper: node " << i << " has no model installed by IntersectionsHelper");
+      NS_ABORT_MSG_IF (model->IsInitialized (),
+                       "IntersectionsHelper: node " << i << " has started driving, its streams can no longer change");
+      model->AssignStreams (stream + i);
+      job.models[i] = model;
+    }
+  Draw (job);
+  return c.GetN ();
+}
+
+void
+IntersectionsHelper::Draw (Job &job) const
+{
+  ParallelFor (job.models.size (), m_threads, 1024, &IntersectionsHelper::DrawRange, &job);
+}
+
+void
+IntersectionsHelper::DrawRange (void *job, uint32_t begin, uint32_t end)
+{
+  Job *j = static_cast<Job *> (job);
+  for (uint32_t i = begin; i < end; i++)
+    {
+      j->models[i]->DrawStart ();
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,127 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef INTERSECTIONS_HELPER_H
+#define INTERSECTIONS_HELPER_H
+
+#include "ns3/object-factory.h"
+#include "ns3/attribute.h"
+#include "ns3/node-container.h"
+#include "position-allocator.h"
+#include "intersections.h"
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Install Intersections on many nodes at once.
+ *
+ * MobilityHelper creates each model through an ObjectFactory, which sets
+ * every attribute again, parses Speed into a new random variable and lets
+ * each model build its own RoadGrid. This helper creates a single
+ * prototype model with the attributes and copies it for every node: the
+ * copies share the configuration of the prototype, RoadGrid, TurnPool and
+ * TurnMatrix and Speed included, and each gets its own stream number,
+ * so each vehicle draws from its own PhiloxStream as with MobilityHelper.
+ * The positions come from GetNextBatch, so the vehicles are placed as
+ * MobilityHelper would place them.
+ *
+ * The heading, lane, speed offset, Markov counters and first turn of the
+ * vehicles are then drawn by Install, on SetThreads threads; scheduling
+ * the first walk step stays in DoInitialize. The draws are only a small
+ * part of an Install, the rest (copying the models, aggregating them to
+ * the nodes) being serial, so more threads hardly shorten it:
+ * bench-intersections-scale --helper measures the install time against
+ * MobilityHelper.
+ *
+ * Since the start state is drawn by Install, Intersections::AssignStreams
+ * on a model afterwards does not change it: give the streams to SetStream
+ * before Install, or to AssignStreams of this helper, which draws the
+ * start state again.
+ */
+class IntersectionsHelper
+{
+public:
+  IntersectionsHelper ();
+
+  /**
+   * \param name the name of an attribute of Intersections
+   * \param value its value for the installed models
+   */
+  void SetAttribute (std::string name, const AttributeValue &value);
+  /**
+   * \param allocator the allocator placing the vehicles
+   */
+  void SetPositionAllocator (Ptr<PositionAllocator> allocator);
+  /**
+   * \param threads the number of threads drawing the start state, 0 for
+   *        one per hardware thread. The copying and aggregation of the
+   *        models stay on the calling thread.
+   */
+  void SetThreads (uint32_t threads);
+  /**
+   * The i-th model of the next Install uses stream stream + i, which is
+   * what Intersections::AssignStreams (stream + i) gives it.
+   *
+   * \param stream first stream index to use, or -1 to let the models
+   *        take the next free streams
+   */
+  void SetStream (int64_t stream);
+
+  /**
+   * \brief Aggregate an Intersections model to each node
+   * \param c nodes without a mobility model
+   */
+  void Install (NodeContainer c) const;
+
+  /**
+   * \brief Assign streams to the models and draw their start state again
+   *
+   * The i-th model uses stream stream + i, as with SetStream. The models must have been installed by this helper
+   * and not be initialized yet.
+   *
+   * \param c nodes the models were installed on
+   * \param stream first stream index to use
+   * \return the number of stream indices used
+   */
+  int64_t AssignStreams (NodeContainer c, int64_t stream) const;
+
+private:
+  /** The models an Install draws the start state of, shared by its threads. */
+  struct Job
+  {
+    std::vector<Ptr<Intersections> > models; //!< the models
+  };
+
+  /**
+   * Draw the start state of the models [begin, end) of a Job.
+   */
+  static void DrawRange (void *job, uint32_t begin, uint32_t end);
+  /**
+   * Draw the start state of all the models of a Job.
+   */
+  void Draw (Job &job) const;
+
+  ObjectFactory m_factory; //!< factory of the prototype
+  Ptr<PositionAllocator> m_position; //!< placement of the vehicles
+  uint32_t m_threads; //!< number of threads drawing the start state
+  int64_t m_stream; //!< first stream index of the next Install, or -1
+};
+
+} // namespace ns3
+
+#endif /* INTERSECTIONS_HELPER_H */
@@ -18,14 +18,22 @@
  * Author: Mathieu Lacage <mathieu.lacage@sophia.inria.fr>
  */
 #include "intersections.h"
+#include "latency-histogram.h"
 #include "ns3/enum.h"
+#include "ns3/boolean.h"
 #include "ns3/double.h"
 #include "ns3/string.h"
 #include "ns3/pointer.h"
 #include "ns3/uinteger.h"
 #include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/rng-stream.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/abort.h"
 #include "ns3/log.h"
+#include <algorithm>
 #include <cmath>
+#include <iomanip>
 
 namespace ns3 {
 
@@ -33,6 +41,56 @@ NS_LOG_COMPONENT_DEFINE ("Intersections");
 
 NS_OBJECT_ENSURE_REGISTERED (Intersections);
 
+// counters of the models disposed in this run
+static Intersections::Counters g_totalCounters;
+// Simulator::Destroy ran since the last model was disposed
+static bool g_totalCountersClosed = false;
+// CloseTotalCounters is scheduled for the end of this run
+static bool g_totalCountersScheduled = false;
+
+/**
+ * Mark the sum of the counters as complete, so the next model disposed
+ * starts a new one. Scheduled with Simulator::ScheduleDestroy: destroy
+ * events scheduled while destroying still run, after the models the
+ * nodes dispose of.
+ */
+static void
+CloseTotalCounters (void)
+{
+  g_totalCountersClosed = true;
+  g_totalCountersScheduled = false;
+}
+
+// default of the Bounds attribute, which a RoadGrid replaces silently
+static const Rectangle g_defaultBounds (0.0, 100.0, 0.0, 100.0);
+
+/**
+ * \param speed a random variable
+ * \param min set to the low end of its values
+ * \param max set to their high end
+ * \return false if it is neither Constant nor Uniform, which a
+ *         PhiloxStream cannot draw for it
+ */
+static bool
+GetRange (Ptr<RandomVariableStream> speed, double &min, double &max)
+{
+  Ptr<ConstantRandomVariable> constant = DynamicCast<ConstantRandomVariable> (speed);
+  if (constant != 0)
+    {
+      min = max = constant->GetConstant ();
+      return true;
+    }
+  Ptr<UniformRandomVariable> uniform = DynamicCast<UniformRandomVariable> (speed);
+  if (uniform != 0)
+    {
+      min = uniform->GetMin ();
+      max = uniform->GetMax ();
+      return true;
+    }
+  min = max = 0;
+  return false;
+}
+
 TypeId
 Intersections::GetTypeId (void)
 {
@@ -42,499 +100,816 @@ Intersections::GetTypeId (void)
     .AddConstructor<Intersections> ()
     .AddAttribute ("Grid", "number of lines",
                    UintegerValue (2),
-                   MakeUintegerAccessor (&Intersections::m_grid),
+                   MakeUintegerAccessor (&Intersections::SetGrid,
+                                         &Intersections::GetGrid),
                    MakeUintegerChecker<uint32_t> ())
      .AddAttribute ("Intersection", "number of intersections",
                     UintegerValue (1),
-                    MakeUintegerAccessor (&Intersections::m_intersection),
+                    MakeUintegerAccessor (&Intersections::SetIntersection,
+                                          &Intersections::GetIntersection),
                     MakeUintegerChecker<uint32_t> ())
     .AddAttribute ("Distance", "Distance between intersections",
                    DoubleValue (500.0),
-                   MakeDoubleAccessor (&Intersections::m_distance),
+                   MakeDoubleAccessor (&Intersections::SetDistance,
+                                      &Intersections::GetDistance),
                    MakeDoubleChecker<double> ())
     .AddAttribute ("Speed", "A random variable used to pick the speed (m/s).",
                    StringValue ("ns3::UniformRandomVariable[Min=16|Max=18]"),
-                   MakePointerAccessor (&Intersections::m_speed),
+                   MakePointerAccessor (&Intersections::SetSpeed,
+                                       &Intersections::GetSpeed),
                    MakePointerChecker<RandomVariableStream> ())
+    .AddAttribute ("Seed", "The seed of the random streams of the vehicles, mixed with RngRun.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&Intersections::SetSeed,
+                                         &Intersections::GetSeed),
+                   MakeUintegerChecker<uint64_t> ())
      .AddAttribute ("Bounds",
-                    "Bounds of the area to cruise.",
-                    RectangleValue (Rectangle (0.0, 100.0, 0.0, 100.0)),
-                    MakeRectangleAccessor (&Intersections::m_bounds),
+                    "Bounds of the area to cruise; with a RoadGrid, those of the "
+                    "RoadGrid are used instead.",
+                    RectangleValue (g_defaultBounds),
+                    MakeRectangleAccessor (&Intersections::SetBounds,
+                                          &Intersections::GetBounds),
                     MakeRectangleChecker ())
      .AddAttribute ("DeltaSpeed", "Delta value of speeds",
                     DoubleValue (5.556),
-                    MakeDoubleAccessor (&Intersections::m_delta),
-                    MakeDoubleChecker<double> ());
+                    MakeDoubleAccessor (&Intersections::SetDeltaSpeed,
+                                       &Intersections::GetDeltaSpeed),
+                    MakeDoubleChecker<double> ())
+     .AddAttribute ("RoadGrid",
+                    "The road layout shared with the position allocator. "
+                    "If set, Grid, Intersection, Distance and Bounds are taken from it.",
+                    PointerValue (),
+                    MakePointerAccessor (&Intersections::SetRoadGrid,
+                                         &Intersections::GetRoadGrid),
+                    MakePointerChecker<RoadGrid> ())
+     .AddAttribute ("EventDriven",
+                    "If true, the walk is not polled every 0.1 s: a single event is "
+                    "scheduled at the step where the vehicle reaches its next turn "
+                    "point, lane change point or boundary. Only a constant Speed "
+                    "leaves steps to skip: with a random one, the speed changes on "
+                    "every step and the walk is still polled.",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&Intersections::SetEventDriven,
+                                        &Intersections::GetEventDriven),
+                    MakeBooleanChecker ())
+     .AddAttribute ("CoalesceCourseChange",
+                    "If true, CourseChange is only notified on turns, lane changes, "
+                    "rebounds and speed changes instead of on every step.",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&Intersections::SetCoalesce,
+                                        &Intersections::GetCoalesce),
+                    MakeBooleanChecker ())
+     .AddAttribute ("MinCourseChangeInterval",
+                    "Minimum time between two CourseChange notifications; a change "
+                    "coming sooner is notified once the interval has elapsed. Zero "
+                    "notifies every change at once.",
+                    TimeValue (Seconds (0)),
+                    MakeTimeAccessor (&Intersections::SetMinCourseChangeInterval,
+                                     &Intersections::GetMinCourseChangeInterval),
+                    MakeTimeChecker ())
+     .AddAttribute ("TurnPool",
+                    "The pool holding the Markov turn counters; by default one "
+                    "pool is shared by all the models.",
+                    PointerValue (),
+                    MakePointerAccessor (&Intersections::SetTurnPool,
+                                        &Intersections::GetTurnPool),
+                    MakePointerChecker<TurnPool> ())
+     .AddAttribute ("TurnMatrix",
+                    "If set, the turns are drawn from these turning ratios by "
+                    "intersection, approach and previous turn instead of from the "
+                    "Markov counters of the vehicle.",
+                    PointerValue (),
+                    MakePointerAccessor (&Intersections::SetTurnMatrix,
+                                        &Intersections::GetTurnMatrix),
+                    MakePointerChecker<TurnMatrix> ())
+     .AddAttribute ("WalkSteps", "The number of walk step events scheduled.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_walkSteps),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("StraightTurns", "The number of intersections crossed going straight.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_straightTurns),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("RightTurns", "The number of right turns.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_rightTurns),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("LeftTurns", "The number of left turns.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_leftTurns),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("LaneChanges", "The number of lane changes on entering a new block.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_laneChanges),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("Rebounds", "The number of rebounds on the bounds.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_rebounds),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("PositionQueries", "The number of GetPosition calls.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_positionQueries),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddAttribute ("PositionCacheHits",
+                    "The number of GetPosition calls answered from the cached position.",
+                    TypeId::ATTR_GET,
+                    UintegerValue (0),
+                    MakeUintegerAccessor (&Intersections::m_positionHits),
+                    MakeUintegerChecker<uint64_t> ())
+     .AddTraceSource ("Counters",
+                      "The counters of the model, when it is disposed.",
+                      MakeTraceSourceAccessor (&Intersections::m_countersTrace),
+                      "ns3::Intersections::CountersCallback");
   return tid;
 }
 
+Intersections::Config::Config ()
+  : minSpeed (0),
+    maxSpeed (0),
+    sharedSpeed (false),
+    seed (1),
+    distance (0),
+    delta (0),
+    grid (0),
+    intersection (0),
+    eventDriven (false),
+    coalesce (false)
+{
+}
+
+Intersections::Intersections ()
+  : m_config (Create<Config> ()),
+    m_deltaspeed (0),
+    m_place (),
+    m_speed (0),
+    m_turns (),
+    b_init (1),
+    b_poll (0),
+    m_started (0),
+    m_courseChanged (1),
+    m_constantSpeed (0),
+    m_positionValid (0),
+    m_rng (0, 0),
+    m_stream (RngSeedManager::GetNextStreamIndex ()),
+    m_positionQueries (0),
+    m_positionHits (0),
+    m_walkSteps (0),
+    m_straightTurns (0),
+    m_rightTurns (0),
+    m_leftTurns (0),
+    m_laneChanges (0),
+    m_rebounds (0)
+{
+}
+
 void
 Intersections::DoInitialize (void)
 {
-  Vector position = m_helper.GetCurrentPosition ();
-  double Rx = position.x - (m_distance / 2 - (3 * m_grid + 1.5)) - ((int)((double)position.x/m_distance) * m_distance);
-  double Ry = position.y - (m_distance / 2 - (3 * m_grid + 1.5)) - ((int)((double)position.y/m_distance) * m_distance);
-  if(Rx > 0 && (double)Rx/3 - (int)((double)Rx/3) == 0){
-    if(Rx <= 3 * m_grid){
-      direction = 0;
-    }else{
-      direction = 1;
+  if (!m_started)
+    {
+      CheckRoadGrid ();
+      if (m_config->turnPool == 0 && m_config->turnMatrix == 0)
+        {
+          GetOwnConfig ().turnPool = TurnPool::GetDefault ();
+        }
+      NS_ASSERT (m_config->bounds.IsInside (m_position));
+      DrawStart ();
+      m_started = true;
+      if (m_config->turnMatrix == 0)
+        {
+          m_config->turnPool->AddUsers (1);
+        }
     }
-  }else{
-    if(Ry <= 3 * m_grid){
-      direction = 2;
-    }else{
-      direction = 3;
+
+  // a random Speed changes the speed on every step: none can be skipped
+  m_constantSpeed = !m_config->sharedSpeed && m_config->minSpeed == m_config->maxSpeed;
+  if (m_config->eventDriven && !m_constantSpeed)
+    {
+      NS_LOG_WARN ("Intersections: EventDriven polls every step with a random Speed");
     }
-  }
 
-  m_deltaspeed = UniformRandomVariable ().GetValue (-m_delta, m_delta);
+  INTERSECTIONS_PROFILE_DUMP ();
+  DoInitializePrivate ();
+  MobilityModel::DoInitialize ();
+}
 
-  if(m_grid == 1){
-    if(CalPercent(position.x, m_distance) < m_distance/2 - 3 * m_grid && CalPercent(position.y, m_distance) > m_distance/2) b_st = true;
-    else if(CalPercent(position.x, m_distance) > m_distance/2 + 3 * m_grid && CalPercent(position.y, m_distance) < m_distance/2) b_st = true;
-    else if(CalPercent(position.x, m_distance) < m_distance/2 && CalPercent(position.y, m_distance) < m_distance/2 - 3 * m_grid) b_st = true;
-    else if(CalPercent(position.x, m_distance) > m_distance/2 && CalPercent(position.y, m_distance) > m_distance/2 + 3 * m_grid) b_st = true;
-    else b_st = false;
-  } else {
-    b_st = false;
-  }
+void
+Intersections::CheckRoadGrid (void)
+{
+  if (m_config->roadGrid == 0)
+    {
+      // no shared layout: build one from our own attributes
+      Config &c = GetOwnConfig ();
+      c.roadGrid = CreateObject<RoadGrid> ();
+      c.roadGrid->SetGrid (c.grid);
+      c.roadGrid->SetIntersection (c.intersection);
+      c.roadGrid->SetDistance (c.distance);
+    }
+  else
+    {
+      // the RoadGrid decides, whatever the order the attributes were set in
+      Rectangle bounds = m_config->roadGrid->GetBounds ();
+      const Rectangle &b = m_config->bounds;
+      if (b.xMin != bounds.xMin || b.xMax != bounds.xMax || b.yMin != bounds.yMin || b.yMax != bounds.yMax)
+        {
+          if (b.xMin != g_defaultBounds.xMin || b.xMax != g_defaultBounds.xMax
+              || b.yMin != g_defaultBounds.yMin || b.yMax != g_defaultBounds.yMax)
+            {
+              NS_LOG_WARN ("Intersections: Bounds " << b << " replaced by those of the RoadGrid, " << bounds);
+            }
+          GetOwnConfig ().bounds = bounds;
+        }
+    }
+  NS_ABORT_MSG_IF (m_config->roadGrid->GetGrid () > 0x10000,
+                   "Intersections: at most 65536 lanes each way");
+}
 
-  /*Markov initialization */
-  Num = 100;
-  p1 = UniformRandomVariable().GetValue(0, 100);
-  p2 = UniformRandomVariable().GetValue(0, 100 - p1);
-  p3 = 100 - p1 - p2;
-  n_r = (int) UniformRandomVariable().GetValue(0, m_grid-0.01);
-
-  double a = UniformRandomVariable ().GetValue (0, 100);
-  if((p1 >= 5 && a < p1) || (p1 < 5 && a < 5)){
-    ch_direction = 0; 
-  }else if((p2 >= 5 && a < p1 + p2) || (p2 < 5 && a < p1 + 5)){
-    ch_direction = 1;
-  }else {
-    ch_direction = 2;
-  }
+void
+Intersections::DrawStart (void)
+{
+  // the position as set, until the start state is drawn
+  m_config->roadGrid->Start (m_place, m_position);
+  m_positionValid = false;
 
+  // RngRun selects the run, as for the ns-3 streams
+  m_rng = PhiloxStream (m_config->seed ^ (RngSeedManager::GetRun () << 32), m_stream);
+  m_deltaspeed = m_rng.GetValue (-m_config->delta, m_config->delta);
 
-  DoInitializePrivate ();
-  MobilityModel::DoInitialize ();
+  /*Markov initialization */
+  // drawn even with a TurnMatrix, so the stream stays aligned
+  int p1 = m_rng.GetValue (0, 100);
+  int p2 = m_rng.GetValue (0, 100 - p1);
+  double u = m_rng.GetValue (0, 3);
+  if (m_config->turnMatrix != 0)
+    {
+      // no turn taken yet: as if the vehicle had gone straight
+      m_place.turn = m_config->turnMatrix->Sample (GetRoadPosition (m_place.offset), m_place.heading, 0, false, u, m_turnSet);
+    }
+  else
+    {
+      m_config->turnPool->Start (m_turns, p1, p2, 100 - p1 - p2);
+      m_place.turn = m_config->turnPool->Sample (m_turns, u);
+    }
+}
+
+Ptr<Intersections>
+Intersections::Clone (void) const
+{
+  NS_ASSERT (!IsInitialized ());
+  Ptr<Intersections> model = CopyObject<Intersections> (Ptr<const Intersections> (this));
+  model->m_stream = RngSeedManager::GetNextStreamIndex ();
+  return model;
 }
 
 void
 Intersections::DoInitializePrivate (void)
 {
-  m_helper.Update ();
-  double speed = m_speed->GetValue ();
-  int i = direction;
-  Vector vector;
+  INTERSECTIONS_PROFILE_SCOPE ("Intersections::DoInitializePrivate");
+  Advance ();
   if(b_init){
-    vector = Vector (((i * 2 - 5) * (i / 2)) * (speed + m_deltaspeed),
-                    ((1 - (i / 2)) * (1 - 2 * i)) * (speed + m_deltaspeed), 0);
+    m_speed = DrawSpeedValue () + m_deltaspeed;
     b_init = false;
+    // the next step sets the speed through DrawSpeed, so it cannot be skipped
+    b_poll = true;
   }else{
-    vector = InputVelocity();
+    double speed = DrawSpeed ();
+    if (speed != m_speed)
+      {
+        m_courseChanged = true;
+      }
+    m_speed = speed;
   }
 
-  m_helper.SetVelocity (vector);
-  m_helper.Unpause ();
-
   DoWalk (Seconds(0.1));
 }
 
-Vector Intersections::InputVelocity(){
-  Vector velocity = m_helper.GetVelocity ();
-  double speed = m_speed->GetValue () + m_deltaspeed;
-  int x1 = speed * 1000;
-  int x2 = x1 / 10;
-  speed = speed - (x1-x2*10)*0.001 + ch_direction*0.001;
-  //Vector velocity(0, 0, 0);
-  if(velocity.x == 0){
-    if(velocity.y > 0)
-      velocity.y = speed;
-    else
-      velocity.y = speed * (-1);
-  } else {
-    if(velocity.x > 0)
-      velocity.x = speed;
-    else
-      velocity.x = speed * (-1);
-  }
-  //std::cout << "a : " << velocity << "\n";
-  return velocity;
+double
+Intersections::DrawSpeedValue (void)
+{
+  const Config &config = *m_config;
+  if (config.sharedSpeed)
+    {
+      return config.speed->GetValue ();
+    }
+  // a constant speed takes nothing from the stream
+  if (config.minSpeed == config.maxSpeed)
+    {
+      return config.minSpeed;
+    }
+  return m_rng.GetValue (config.minSpeed, config.maxSpeed);
 }
 
-Vector Intersections::DirVelocity(Vector velocity){
-  double speed = m_speed->GetValue () + m_deltaspeed;
+double
+Intersections::DrawSpeed (void)
+{
+  double speed = DrawSpeedValue () + m_deltaspeed;
   int x1 = speed * 1000;
   int x2 = x1 / 10;
-  speed = speed - (x1-x2*10)*0.001 + ch_direction*0.001;
-  //Vector velocity(0, 0, 0);
-  if(velocity.x == 0){
-    if(velocity.y > 0)
-      velocity.y = speed;
-    else
-      velocity.y = speed * (-1);
-  } else {
-    if(velocity.x > 0)
-      velocity.x = speed;
-    else
-      velocity.x = speed * (-1);
-  }
-  //std::cout << "a : " << velocity << "\n";
-  return velocity;
+  return speed - (x1-x2*10)*0.001 + m_place.turn*0.001;
 }
 
 void
 Intersections::DoWalk (Time delayLeft)
 {
-  Vector position = m_helper.GetCurrentPosition ();
-  Vector speed = m_helper.GetVelocity ();
-  Vector nextPosition = position;
-  nextPosition.x += speed.x * delayLeft.GetSeconds ();
-  nextPosition.y += speed.y * delayLeft.GetSeconds ();
-  m_event.Cancel ();
-  if (m_bounds.IsInside (nextPosition))
+  INTERSECTIONS_PROFILE_SCOPE ("Intersections::DoWalk");
+  // every change of course ends up here
+  m_positionValid = false;
+  // m_place.offset is where the vehicle is now
+  const RoadGrid &road = *m_config->roadGrid;
+  double length = RoadGrid::GetSign (m_place.heading) * m_speed * delayLeft.GetSeconds ();
+  double offset = m_place.offset;
+  Time delay = delayLeft;
+  if (m_config->eventDriven && m_constantSpeed && !b_poll)
   {
-    if(b_st){
-      if(is_intersection(speed, nextPosition, position)){
-        m_event = Simulator::Schedule (delayLeft, &Intersections::ChangeVelocity, this, speed, nextPosition, position);
-        //ChangeVelocity(speed, nextPosition, position);
-      } else{
-        m_event = Simulator::Schedule (delayLeft, &Intersections::DoInitializePrivate, this);
-      }
-    } else {
-      if(is_changeRN(speed, nextPosition, position)){
-        m_event = Simulator::Schedule (delayLeft, &Intersections::ChangeRN, this, speed, nextPosition, position);
-        //ChangeRN(speed, nextPosition, position);
-      } else{
-        m_event = Simulator::Schedule (delayLeft, &Intersections::DoInitializePrivate, this);
-      }
-    }
+    // skip the steps on which the polling walk would only move on
+    uint64_t steps = road.GetWalkSteps (m_place, length, m_config->bounds);
+    offset += length * (steps - 1);
+    delay = TimeStep (delayLeft.GetTimeStep () * steps);
   }
-  else
+  b_poll = false;
+  m_walkSteps++;
+  double next = offset + length;
+  m_event.Cancel ();
+  switch (road.GetStep (m_place, offset, next, m_config->bounds))
   {
-    nextPosition = m_bounds.CalculateIntersection (position, speed);
-    m_event = Simulator::Schedule (delayLeft, &Intersections::Rebound, this, delayLeft);
+  case RoadGrid::WALK:
+    m_event = Simulator::Schedule (delay, &Intersections::DoInitializePrivate, this);
+    break;
+  case RoadGrid::TURN:
+    m_event = Simulator::Schedule (delay, &Intersections::ChangeVelocity, this, offset, next);
+    break;
+  case RoadGrid::LANE:
+    m_event = Simulator::Schedule (delay, &Intersections::ChangeRN, this, offset);
+    break;
+  case RoadGrid::REBOUND:
+    m_event = Simulator::Schedule (delay, &Intersections::Rebound, this, delayLeft);
+    break;
   }
-  NotifyCourseChange ();
+  if (!m_config->coalesce || m_courseChanged)
+    {
+      m_courseChanged = false;
+      DoNotifyCourseChange ();
+    }
 }
 
 void
-Intersections::Rebound (Time delayLeft)
+Intersections::DoNotifyCourseChange (void)
 {
-  m_helper.UpdateWithBounds (m_bounds);
-  Vector position = m_helper.GetCurrentPosition ();
-  Vector speed = m_helper.GetVelocity ();
-  b_st = true;
-  switch (m_bounds.GetClosestSide (position))
+  if (m_notifyEvent.IsRunning ())
     {
-    case Rectangle::RIGHT:
-      if(ch_direction == 1){
-        position.y -= CalPercent(position.y, m_distance) - (m_distance/2 - (3*m_grid-1.5));
-      } else if(ch_direction == 2){
-        position.y -= CalPercent(position.y, m_distance) - (m_distance/2 - 1.5);
-      } else {
-        position.y -= 3 * m_grid;
-      }
-      position.x -= 1;
-      break;
-    case Rectangle::LEFT:
-      if(ch_direction == 1){
-        position.y += m_distance/2 + (3*m_grid-1.5) - CalPercent(position.y, m_distance);
-      } else if(ch_direction == 2){
-        position.y += m_distance/2 + 1.5 - CalPercent(position.y, m_distance);
-      } else {
-        position.y += 3 * m_grid;
-      }
-      position.x += 1;
-      break;
-    case Rectangle::TOP:
-      if(ch_direction == 1){
-        position.x += m_distance/2+(3*m_grid-1.5) - CalPercent(position.x, m_distance);
-      } else if(ch_direction == 2){
-        position.x += m_distance/2+1.5 - CalPercent(position.x, m_distance);
-      } else {
-        position.x += 3 * m_grid;
-      }
-      position.y -= 1;
-      break;
-    case Rectangle::BOTTOM:
-      if(ch_direction == 1){
-        position.x -= CalPercent(position.x, m_distance) - (m_distance/2-(3*m_grid-1.5));
-      } else if(ch_direction == 2){
-        position.x -= CalPercent(position.x, m_distance) - (m_distance/2-1.5);
-      } else {
-        position.x -= 3 * m_grid;
-      }
-      position.y += 1;
-      break;
+      // the pending notification will report this change too
+      return;
+    }
+  Time now = Simulator::Now ();
+  if (now < m_nextNotify)
+    {
+      m_notifyEvent = Simulator::Schedule (m_nextNotify - now, &Intersections::DoNotifyCourseChange, this);
+      return;
     }
+  m_nextNotify = now + m_config->minNotifyInterval;
+  NotifyCourseChange ();
+}
 
-  speed.x = speed.x * (-1);
-  speed.y = speed.y * (-1);
-  m_helper.SetPosition (position);
-  m_helper.SetVelocity (speed);
-  m_helper.Unpause ();
+void
+Intersections::Rebound (Time delayLeft)
+{
+  INTERSECTIONS_PROFILE_SCOPE ("Intersections::Rebound");
+  m_config->roadGrid->Rebound (m_place, GetCurrentOffset (), m_config->bounds);
+  m_offsetTime = Simulator::Now ();
+
+  m_courseChanged = true;
+  m_rebounds++;
   DoWalk (delayLeft);
 }
 
-void Intersections::ChangeVelocity(Vector speed, Vector nextPosition, Vector position){
-  b_st = false;
-  Num++;
-  if(ch_direction == 0) p1++;
-  else if(ch_direction == 1) p2++;
-  else p3++;
-
-  if(speed.x == 0){
-    if(speed.y < 0){
-      switch (ch_direction)
-      {
-      case 1: // up -> right
-        position.x += m_distance/2+(3*m_grid-1.5) - CalPercent(nextPosition.y, m_distance);
-        position.y -= CalPercent(position.y, m_distance) - (m_distance/2 + (3*m_grid-1.5));
-        speed.x = -1 * speed.y;
-        speed.y = 0;
-        break;
-      case 2: // up -> left
-        position.x -= m_distance/2-1.5 - CalPercent(nextPosition.y, m_distance);
-        position.y -= CalPercent(position.y, m_distance) - (m_distance/2-1.5);
-        speed.x = 1 * speed.y;
-        speed.y = 0;
-        break;      
-      default:
-        break;
-      }
-    } else if(speed.y > 0){
-      switch (ch_direction)
-      {
-      case 1: // down -> left
-        position.x -= CalPercent(nextPosition.y, m_distance) - (m_distance/2-(3*m_grid-1.5));
-        position.y += m_distance/2-(3*m_grid-1.5) - CalPercent(position.y, m_distance);
-        speed.x = -1 * speed.y;
-        speed.y = 0;
-        break;
-      case 2: // down -> right
-        position.x += CalPercent(nextPosition.y, m_distance) - (m_distance/2+1.5);
-        position.y += m_distance/2+1.5 - CalPercent(position.y, m_distance);
-        speed.x = speed.y;
-        speed.y = 0;
-        break;      
-      default:
-        break;
-      }
-    }
-  }else if(speed.y == 0){
-    if(speed.x < 0){
-      switch (ch_direction)
-      {
-      case 1: // left -> up
-        position.y -= m_distance/2+(3*m_grid-1.5) - CalPercent(nextPosition.x, m_distance);
-        position.x -= CalPercent(position.x, m_distance) - (m_distance/2+(3*m_grid-1.5));
-        speed.y = 1 * speed.x;
-        speed.x = 0;
-        break;
-      case 2: // left -> down
-        position.y += m_distance/2-1.5 - CalPercent(nextPosition.x, m_distance);
-        position.x -= CalPercent(position.x, m_distance) - (m_distance/2-1.5);
-        speed.y = -1 * speed.x;
-        speed.x = 0;
-        break;      
-      default:
-        break;
-      }
-    } else if(speed.x > 0){
-      switch (ch_direction)
-      {
-      case 1: // right -> down
-        position.y += CalPercent(nextPosition.x, m_distance) - (m_distance/2-(3*m_grid-1.5));
-        position.x += (m_distance/2-(3*m_grid-1.5)) - CalPercent(position.x, m_distance);
-        speed.y = speed.x;
-        speed.x = 0;
-        break;
-      case 2: // right -> up
-        position.y -= CalPercent(nextPosition.x, m_distance) - (m_distance/2+1.5);
-        position.x += (m_distance/2+1.5) - CalPercent(position.x, m_distance);
-        speed.y = -1*speed.x;
-        speed.x = 0;
-        break;      
-      default:
-        break;
-      }
+void Intersections::ChangeVelocity(double offset, double next){
+  INTERSECTIONS_PROFILE_SCOPE ("Intersections::ChangeVelocity");
+  m_courseChanged = true;
+  (m_place.turn == 1 ? m_rightTurns : m_place.turn == 2 ? m_leftTurns : m_straightTurns)++;
+  if (m_config->turnMatrix == 0)
+    {
+      m_config->turnPool->Count (m_turns, m_place.turn);
     }
-  }
-  ch_direction = ChangedDirection();
-  if(speed.x == 0) speed.y = DirVelocity(speed).y;
-  else speed.x = DirVelocity(speed).x;
 
-  m_helper.SetPosition (position);
-  m_helper.SetVelocity (speed);
-  m_helper.Unpause ();
+  // the vehicle is still where it was when the turn was decided
+  m_config->roadGrid->Turn (m_place, offset, next);
+  m_offsetTime = Simulator::Now ();
+
+  m_place.turn = ChangedDirection();
+  m_speed = DrawSpeed ();
   DoWalk (Seconds(0.1));
 }
 
-void Intersections::ChangeRN(Vector speed, Vector nextPosition, Vector position){
-  b_st = true;
+void Intersections::ChangeRN(double offset){
+  INTERSECTIONS_PROFILE_SCOPE ("Intersections::ChangeRN");
+  m_courseChanged = true;
+  m_laneChanges++;
 
-  if(speed.x == 0){
-    if(speed.y < 0){
-      if(ch_direction == 1 && (CalPercent(position.x, m_distance) < m_distance/2+(3*m_grid-1.5))){
-        position.x += m_distance/2+(3*m_grid-1.5) - CalPercent(position.x, m_distance);
-      } else if(ch_direction == 2 && (CalPercent(position.x, m_distance) > m_distance/2+1.5)){
-        position.x -= CalPercent(position.x, m_distance) - (m_distance/2+1.5);
-      }
-    } else {
-      if(ch_direction == 1 && (CalPercent(position.x, m_distance) > m_distance/2-(3*m_grid-1.5))){
-        position.x -= CalPercent(position.x, m_distance) - (m_distance/2-(3*m_grid-1.5));
-      } else if(ch_direction == 2 && (CalPercent(position.x, m_distance) < (m_distance/2-1.5))){
-        position.x += (m_distance/2-1.5) - CalPercent(position.x, m_distance);
-      }
-    }    
-  }else if(speed.y == 0){
-    if(speed.x < 0){
-      if(ch_direction == 1 && (CalPercent(position.y, m_distance) > (m_distance/2-(3*m_grid-1.5)))){
-        position.y -= CalPercent(position.y, m_distance) - (m_distance/2-(3*m_grid-1.5));
-      } else if(ch_direction == 2 && (CalPercent(position.y, m_distance) < m_distance/2-1.5)){
-        position.y += m_distance/2-1.5 - CalPercent(position.y, m_distance);
-      }
-    } else {
-      if(ch_direction == 1 && (CalPercent(position.y, m_distance) < m_distance/2+(3*m_grid-1.5))){
-        position.y +=  m_distance/2+(3*m_grid-1.5) - CalPercent(position.y, m_distance);
-      } else if(ch_direction == 2 && (CalPercent(position.y, m_distance) > m_distance/2+1.5)){
-        position.y -= CalPercent(position.y, m_distance) - (m_distance/2+1.5);
-      }
-    }
-  }
+  // the vehicle is still where it was when the lane change was decided,
+  // short of the block edge
+  m_config->roadGrid->ChangeLane (m_place, offset);
+  m_offsetTime = Simulator::Now ();
 
-  m_helper.SetPosition (position);
-  m_helper.SetVelocity (speed);
-  m_helper.Unpause ();
   DoWalk (Seconds(0.1));
 }
 
-int Intersections::ChangedDirection(){
-  double tmp = UniformRandomVariable().GetValue(0, 100);
-  double pp[3];
-  pp[0] = (double)100 * p1/Num;
-  pp[1] = (double)100 * p2/Num;
-  pp[2] = (double)100 * p3/Num;
-
-  if((pp[0] >= 5 && tmp < pp[0]) || (pp[0] < 5 && tmp < 5)){
-    ch_direction = 0; 
-  }else if((pp[1] >= 5 && tmp < pp[0] + pp[1]) || (pp[1] < 5 && tmp < pp[0] + 5)){
-    ch_direction = 1;
-  }else {
-    ch_direction = 2;
-  }
-  return ch_direction;
-}
-
-bool Intersections::is_intersection(Vector speed, Vector nextPosition, Vector position){
-  if(speed.x == 0){
-    if(ch_direction == 0){ // straight
-      if(speed.y < 0 && m_distance/2 >= CalPercent(nextPosition.y, m_distance))
-        return true;
-      else if(speed.y > 0 && m_distance/2 <= CalPercent(nextPosition.y, m_distance))
-        return true;
-    } else if(ch_direction == 1){ // right
-      if(speed.y < 0 && m_distance/2+(3*m_grid-1.5) >= CalPercent(nextPosition.y, m_distance))
-        return true;
-      else if(speed.y > 0 && m_distance/2-(3*m_grid-1.5) <= CalPercent(nextPosition.y, m_distance))
-        return true;
-    } else if(ch_direction == 2){ // left
-      if(speed.y < 0 && m_distance/2-1.5 >= CalPercent(nextPosition.y, m_distance))
-        return true;
-      else if(speed.y > 0 && m_distance/2+1.5 <= CalPercent(nextPosition.y, m_distance))
-        return true;
-    }
-  }else if(speed.y == 0){
-    if(ch_direction == 0){ // straight
-      if(speed.x < 0 && m_distance/2 >= CalPercent(nextPosition.x, m_distance))
-        return true;
-      else if(speed.x > 0 && m_distance/2 <= CalPercent(nextPosition.x, m_distance))
-        return true;
-    } else if(ch_direction == 1){ // right
-      if(speed.x < 0 && m_distance/2 + (3*m_grid-1.5) >= CalPercent(nextPosition.x, m_distance))
-        return true;
-      else if(speed.x > 0 && m_distance/2-(3*m_grid-1.5) <= CalPercent(nextPosition.x, m_distance))
-        return true;
-    } else if(ch_direction == 2){ // left
-      if(speed.x < 0 && m_distance/2-1.5 >= CalPercent(nextPosition.x, m_distance))
-        return true;
-      else if(speed.x > 0 && m_distance/2+1.5 <= CalPercent(nextPosition.x, m_distance))
-        return true;
+int Intersections::ChangedDirection(void){
+  if (m_config->turnMatrix != 0)
+    {
+      // m_place.turn is still the turn just taken
+      return m_config->turnMatrix->Sample (GetRoadPosition (m_place.offset), m_place.heading, m_place.turn, true, m_rng.GetValue (0, 3), m_turnSet);
     }
-  }
-  return false;
+  return m_config->turnPool->Sample (m_turns, m_rng.GetValue (0, 3));
 }
 
-bool Intersections::is_changeRN(Vector speed, Vector nextPosition, Vector position){
-  if(speed.x == 0){
-    if(speed.y < 0 && (CalPercent(position.y, m_distance) - CalPercent(nextPosition.y, m_distance) < 0)){
-      return true;
-    } else if(speed.y > 0 && (CalPercent(position.y, m_distance) - CalPercent(nextPosition.y, m_distance) > 0)){
-      return true;
-    }
-  } else if(speed.y == 0){
-    if(speed.x < 0 && (CalPercent(position.x, m_distance) - CalPercent(nextPosition.x, m_distance) < 0)){
-      return true;
-    } else if(speed.x > 0 && (CalPercent(position.x, m_distance) - CalPercent(nextPosition.x, m_distance) > 0)){
-      return true;
-    }
-  }
-  return false;
+Vector
+Intersections::GetRoadPosition (double offset) const
+{
+  return m_config->roadGrid->GetPosition (m_place, offset);
 }
 
-double Intersections::CalPercent(double a, double b){
-  double c = a;
-  for(;c >= 0;c-=b){}
-  c += b;
-  return c;
+double
+Intersections::GetCurrentOffset (void) const
+{
+  return m_place.offset + RoadGrid::GetSign (m_place.heading) * m_speed * (Simulator::Now () - m_offsetTime).GetSeconds ();
+}
+
+void
+Intersections::Advance (void)
+{
+  m_place.block += m_config->roadGrid->GetBlock (GetCurrentOffset (), m_place.offset);
+  m_offsetTime = Simulator::Now ();
+}
+
+double Intersections::CalPercent(double a){
+  double offset;
+  m_config->roadGrid->GetBlock (a, offset);
+  return offset;
 }
 
 Vector
 Intersections::GetProbability ()
 {
-  Vector p;
-  p.x = 100 * (double) p1/Num;
-  p.y = 100 * (double) p2/Num;
-  p.z = 100 * (double) p3/Num;
-  return p;
+  if (m_config->turnMatrix != 0)
+    {
+      return m_config->turnMatrix->GetProbability (m_turnSet);
+    }
+  return TurnPool::GetProbability (m_turns);
 }
 
 int Intersections::GetDirection(){
-  return ch_direction;
+  return m_place.turn;
+}
+
+void
+Intersections::SetRoadGrid (Ptr<RoadGrid> roadGrid)
+{
+  GetOwnConfig ().roadGrid = roadGrid;
+}
+
+Ptr<RoadGrid>
+Intersections::GetRoadGrid (void) const
+{
+  return m_config->roadGrid;
+}
+
+Intersections::Config &
+Intersections::GetOwnConfig (void)
+{
+  if (m_config->GetReferenceCount () > 1)
+    {
+      m_config = Create<Config> (*m_config);
+    }
+  return *m_config;
+}
+
+void
+Intersections::SetGrid (uint32_t grid)
+{
+  GetOwnConfig ().grid = grid;
+}
+
+uint32_t
+Intersections::GetGrid (void) const
+{
+  return m_config->grid;
+}
+
+void
+Intersections::SetIntersection (uint32_t intersection)
+{
+  GetOwnConfig ().intersection = intersection;
+}
+
+uint32_t
+Intersections::GetIntersection (void) const
+{
+  return m_config->intersection;
+}
+
+void
+Intersections::SetDistance (double distance)
+{
+  GetOwnConfig ().distance = distance;
+}
+
+double
+Intersections::GetDistance (void) const
+{
+  return m_config->distance;
+}
+
+void
+Intersections::SetSpeed (Ptr<RandomVariableStream> speed)
+{
+  Config &config = GetOwnConfig ();
+  config.speed = speed;
+  config.sharedSpeed = !GetRange (speed, config.minSpeed, config.maxSpeed);
+}
+
+Ptr<RandomVariableStream>
+Intersections::GetSpeed (void) const
+{
+  return m_config->speed;
+}
+
+void
+Intersections::SetSeed (uint64_t seed)
+{
+  GetOwnConfig ().seed = seed;
+}
+
+uint64_t
+Intersections::GetSeed (void) const
+{
+  return m_config->seed;
+}
+
+void
+Intersections::SetBounds (Rectangle bounds)
+{
+  GetOwnConfig ().bounds = bounds;
+}
+
+Rectangle
+Intersections::GetBounds (void) const
+{
+  return m_config->bounds;
+}
+
+void
+Intersections::SetDeltaSpeed (double delta)
+{
+  GetOwnConfig ().delta = delta;
+}
+
+double
+Intersections::GetDeltaSpeed (void) const
+{
+  return m_config->delta;
+}
+
+void
+Intersections::SetEventDriven (bool eventDriven)
+{
+  GetOwnConfig ().eventDriven = eventDriven;
+}
+
+bool
+Intersections::GetEventDriven (void) const
+{
+  return m_config->eventDriven;
+}
+
+void
+Intersections::SetCoalesce (bool coalesce)
+{
+  GetOwnConfig ().coalesce = coalesce;
+}
+
+bool
+Intersections::GetCoalesce (void) const
+{
+  return m_config->coalesce;
+}
+
+void
+Intersections::SetMinCourseChangeInterval (Time interval)
+{
+  GetOwnConfig ().minNotifyInterval = interval;
+}
+
+Time
+Intersections::GetMinCourseChangeInterval (void) const
+{
+  return m_config->minNotifyInterval;
+}
+
+void
+Intersections::SetTurnPool (Ptr<TurnPool> turnPool)
+{
+  GetOwnConfig ().turnPool = turnPool;
+}
+
+Ptr<TurnPool>
+Intersections::GetTurnPool (void) const
+{
+  return m_config->turnPool;
+}
+
+void
+Intersections::SetTurnMatrix (Ptr<TurnMatrix> turnMatrix)
+{
+  GetOwnConfig ().turnMatrix = turnMatrix;
+}
+
+Ptr<TurnMatrix>
+Intersections::GetTurnMatrix (void) const
+{
+  return m_config->turnMatrix;
+}
+
+uint64_t
+Intersections::GetPositionQueries (void) const
+{
+  return m_positionQueries;
+}
+
+uint64_t
+Intersections::GetPositionCacheHits (void) const
+{
+  return m_positionHits;
+}
+
+Intersections::Counters
+Intersections::GetCounters (void) const
+{
+  Counters c;
+  c.walkSteps = m_walkSteps;
+  c.turns[0] = m_straightTurns;
+  c.turns[1] = m_rightTurns;
+  c.turns[2] = m_leftTurns;
+  c.laneChanges = m_laneChanges;
+  c.rebounds = m_rebounds;
+  c.positionQueries = m_positionQueries;
+  c.positionHits = m_positionHits;
+  return c;
+}
+
+Intersections::Counters
+Intersections::GetTotalCounters (void)
+{
+  return g_totalCounters;
+}
+
+Intersections::MemoryUsage
+Intersections::GetMemoryUsage (void) const
+{
+  MemoryUsage m;
+  m.object = sizeof (*this);
+  // the last term is the word the flags are packed in
+  m.state = sizeof (m_place) + sizeof (m_speed) + sizeof (m_offsetTime) + sizeof (m_deltaspeed)
+    + sizeof (m_turns) + sizeof (uint32_t);
+  m.events = sizeof (m_event) + sizeof (m_notifyEvent) + sizeof (m_nextNotify);
+  m.cache = sizeof (m_position) + sizeof (m_positionTime);
+  m.counters = 8 * sizeof (m_walkSteps) + sizeof (m_countersTrace);
+  m.stream = sizeof (m_rng) + sizeof (m_stream);
+  m.shared = sizeof (Config);
+  if (m_config->speed != 0)
+    {
+      m.shared += sizeof (RandomVariableStream) + sizeof (RngStream);
+    }
+  m.shared /= m_config->GetReferenceCount ();
+  m.turnPool = 0;
+  if (m_config->turnPool != 0 && m_config->turnMatrix == 0)
+    {
+      m.turnPool = m_config->turnPool->GetMemoryUsage ()
+        / (double) std::max (m_config->turnPool->GetUsers (), (uint32_t) 1);
+    }
+  m.total = m.object + m.shared + m.turnPool;
+  return m;
+}
+
+void
+Intersections::PrintMemoryUsage (std::ostream &os) const
+{
+  MemoryUsage m = GetMemoryUsage ();
+  std::ios::fmtflags flags = os.flags ();
+  std::streamsize precision = os.precision ();
+  os << std::fixed << std::setprecision (1)
+     << "Intersections: " << m.total << " bytes per vehicle" << std::endl
+     << "  model object      " << std::setw (6) << m.object << std::endl
+     << "    walk state      " << std::setw (6) << m.state << std::endl
+     << "    events          " << std::setw (6) << m.events << std::endl
+     << "    position cache  " << std::setw (6) << m.cache << std::endl
+     << "    counters        " << std::setw (6) << m.counters << std::endl
+     << "    random stream   " << std::setw (6) << m.stream << std::endl
+     << "  shared            " << std::setw (6) << m.shared
+     << "  (configuration shared by " << m_config->GetReferenceCount () << " models)" << std::endl
+     << "  turn tables       " << std::setw (6) << m.turnPool;
+  if (m.turnPool > 0)
+    {
+      os << "  (TurnPool of " << m_config->turnPool->GetMemoryUsage () << " bytes used by "
+         << m_config->turnPool->GetUsers () << " vehicles)";
+    }
+  os << std::endl;
+  os.flags (flags);
+  os.precision (precision);
 }
 
 void
 Intersections::DoDispose (void)
 {
+  if (g_totalCountersClosed)
+    {
+      // the first model of a new run
+      g_totalCounters = Counters ();
+      g_totalCountersClosed = false;
+    }
+  if (!g_totalCountersScheduled)
+    {
+      g_totalCountersScheduled = true;
+      Simulator::ScheduleDestroy (&CloseTotalCounters);
+    }
+  Counters c = GetCounters ();
+  g_totalCounters.walkSteps += c.walkSteps;
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      g_totalCounters.turns[i] += c.turns[i];
+    }
+  g_totalCounters.laneChanges += c.laneChanges;
+  g_totalCounters.rebounds += c.rebounds;
+  g_totalCounters.positionQueries += c.positionQueries;
+  g_totalCounters.positionHits += c.positionHits;
+  m_countersTrace (c);
+  m_notifyEvent.Cancel ();
+  if (m_config->turnPool != 0 && m_config->turnMatrix == 0 && m_started)
+    {
+      m_config->turnPool->RemoveUsers (1);
+    }
   // chain up
   MobilityModel::DoDispose ();
 }
 Vector
 Intersections::DoGetPosition (void) const
 {
-  m_helper.UpdateWithBounds (m_bounds);
-  return m_helper.GetCurrentPosition ();
+  INTERSECTIONS_PROFILE_SCOPE ("Intersections::DoGetPosition");
+  m_positionQueries++;
+  Time now = Simulator::Now ();
+  if (m_positionValid && m_positionTime == now)
+    {
+      m_positionHits++;
+      return m_position;
+    }
+  if (m_started)
+    {
+      // the vehicle can overrun the bounds until its rebound step ends
+      const Rectangle &b = m_config->bounds;
+      m_position = GetRoadPosition (GetCurrentOffset ());
+      m_position.x = std::min (b.xMax, std::max (b.xMin, m_position.x));
+      m_position.y = std::min (b.yMax, std::max (b.yMin, m_position.y));
+    }
+  m_positionTime = now;
+  m_positionValid = true;
+  return m_position;
 }
 void
 Intersections::DoSetPosition (const Vector &position)
 {
-  NS_ASSERT (m_bounds.IsInside (position));
-  m_helper.SetPosition (position);
+  m_positionValid = false;
+  m_courseChanged = true;
+  if (m_started)
+    {
+      NS_ASSERT (m_config->bounds.IsInside (position));
+      m_config->roadGrid->Locate (m_place, position);
+      m_offsetTime = Simulator::Now ();
+    }
+  else
+    {
+      // the heading is drawn from the position on start, once the bounds
+      // are known
+      m_position = position;
+    }
   Simulator::Remove (m_event);
   m_event = Simulator::ScheduleNow (&Intersections::DoInitializePrivate, this);
 }
 Vector
 Intersections::DoGetVelocity (void) const
 {
-  return m_helper.GetVelocity ();
+  double speed = RoadGrid::GetSign (m_place.heading) * m_speed;
+  return m_place.heading < 2 ? Vector (0, speed, 0) : Vector (speed, 0, 0);
 }
 uint8_t
 Intersections::DoGetDirection (void) const
 {
-  return 0;
+  return m_place.heading;
 }
 void
 Intersections::DoSetDirection (const uint8_t direction)
@@ -543,9 +918,13 @@ Intersections::DoSetDirection (const uint8_t direction)
 int64_t
 Intersections::DoAssignStreams (int64_t stream)
 {
-  m_speed->SetStream (stream);
-  //m_direction->SetStream (stream + 1);
-  return 2;
+  // keyed when the start state is drawn
+  m_stream = stream;
+  if (m_config->sharedSpeed)
+    {
+      m_config->speed->SetStream (stream);
+    }
+  return 1;
 }
 
 
@@ -25,8 +25,13 @@
 #include "ns3/event-id.h"
 #include "ns3/rectangle.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
 #include "mobility-model.h"
-#include "constant-velocity-helper.h"
+#include "road-grid.h"
+#include "turn-pool.h"
+#include "turn-matrix.h"
+#include "philox.h"
+#include <ostream>
 
 namespace ns3 {
 
@@ -42,6 +47,12 @@ namespace ns3 {
  * of the model, we rebound on the boundary with a reflexive angle
  * and speed. This model is often identified as a brownian motion
  * model.
+ *
+ * Every vehicle draws from its own PhiloxStream, keyed by Seed, RngRun
+ * and the stream number AssignStreams gives it, the next automatic one
+ * otherwise. A Constant or Uniform Speed is drawn from that stream too;
+ * any other Speed variable draws from its own ns-3 stream, shared by the
+ * models sharing the configuration and set by AssignStreams as well.
  */
 class Intersections : public MobilityModel
 {
@@ -51,6 +62,7 @@ public:
    * \return the object TypeId
    */
   static TypeId GetTypeId (void);
+  Intersections ();
   /** An enum representing the different working modes of this module. */
   enum Mode  {
     MODE_DISTANCE,
@@ -60,15 +72,88 @@ public:
   Vector GetProbability();
   int GetDirection();
 
-  int ch_direction;
+  /**
+   * \param roadGrid the road layout to drive on; its bounds replace the
+   *        Bounds attribute when the model is initialized
+   */
+  void SetRoadGrid (Ptr<RoadGrid> roadGrid);
+  /**
+   * \return the road layout, or 0 if none was set and the model is not initialized yet
+   */
+  Ptr<RoadGrid> GetRoadGrid (void) const;
+
+  /**
+   * \return the number of GetPosition calls so far
+   */
+  uint64_t GetPositionQueries (void) const;
+  /**
+   * \return the number of GetPosition calls answered from the cached position
+   */
+  uint64_t GetPositionCacheHits (void) const;
+
+  /** What the walk of a model did, counted. */
+  struct Counters
+  {
+    uint64_t walkSteps;       //!< walk step events scheduled
+    uint64_t turns[3];        //!< intersections crossed going straight, turning right and left
+    uint64_t laneChanges;     //!< ChangeRN steps, on entering a new block
+    uint64_t rebounds;        //!< rebounds on the bounds
+    uint64_t positionQueries; //!< GetPosition calls
+    uint64_t positionHits;    //!< GetPosition calls answered from the cached position
+  };
+  /**
+   * The counters are also attributes, read only, and reported through
+   * the Counters trace source when the model is disposed.
+   *
+   * \return the counters of this model so far
+   */
+  Counters GetCounters (void) const;
+  /**
+   * The sum starts over with the first model disposed after a
+   * Simulator::Destroy, so it only covers one run.
+   *
+   * \return the sum of the counters of all the models disposed in this
+   *         run, which after Simulator::Destroy is all of them
+   */
+  static Counters GetTotalCounters (void);
+  /**
+   * TracedCallback signature for the counters of a disposed model.
+   *
+   * \param [in] counters The counters of the model.
+   */
+  typedef void (* CountersCallback)(const Counters &counters);
 
-  /* Markov value */
-  int Num;
-  int p1; // straight
-  int p2; // right
-  int p3; // left
+  /** The bytes a model takes, by part. */
+  struct MemoryUsage
+  {
+    uint32_t object;          //!< the model object, with the parts below
+    uint32_t state;           //!< state of the walk: road coordinates, speed, speed offset, turn counters and flags
+    uint32_t events;          //!< walk step and notification events
+    uint32_t cache;           //!< cached position
+    uint32_t counters;        //!< counters and their trace source
+    uint32_t stream;          //!< random stream of the vehicle and its number
+    double shared;            //!< share of the configuration, Speed variable included, among the models using it
+    double turnPool;          //!< share of the TurnPool tables among the models using them
+    double total;             //!< object and shared parts
+  };
+  /**
+   * The heap of the object system (aggregation, attributes) is not
+   * counted. The TurnPool tables are shared out among the vehicles
+   * drawing from them; the turn counters themselves are part of the
+   * walk state, which is kept under 64 bytes.
+   *
+   * \return the bytes this model takes
+   */
+  MemoryUsage GetMemoryUsage (void) const;
+  /**
+   * \param os the stream to print the bytes this model takes to, by part
+   */
+  void PrintMemoryUsage (std::ostream &os) const;
 
 private:
+  friend class IntersectionsBench; // times the private steps, see bench-intersections.cc
+  friend class IntersectionsHelper; // draws the start state of its models ahead of DoInitialize
+
   /**
    * \brief Performs the rebound of the node if it reaches a boundary
    * \param timeLeft The remaining time of the walk
@@ -83,6 +168,31 @@ private:
    * Perform initialization of the object before MobilityModel::DoInitialize ()
    */
   void DoInitializePrivate (void);
+  /**
+   * Build the RoadGrid from Grid, Intersection and Distance if none was
+   * set, else take the bounds from the RoadGrid.
+   */
+  void CheckRoadGrid (void);
+  /**
+   * \brief Draw the heading, speed offset, Markov counters and first
+   *        turn, and put the vehicle on its road at the position it was
+   *        given
+   *
+   * Keys the random stream of the vehicle by the Seed, RngRun and its stream
+   * number first. Only writes to the model, the TurnPool and TurnMatrix
+   * being read only, so models can draw in parallel.
+   */
+  void DrawStart (void);
+  /**
+   * \return a speed drawn from Speed, without the offset of the vehicle
+   */
+  double DrawSpeedValue (void);
+  /**
+   * \return a model with the same attributes, not initialized: it shares
+   *         the Config of this one, RoadGrid, TurnPool, TurnMatrix and
+   *         Speed included, and gets the next automatic stream number
+   */
+  Ptr<Intersections> Clone (void) const;
   virtual void DoDispose (void);
   virtual void DoInitialize (void);
   virtual Vector DoGetPosition (void) const;
@@ -92,32 +202,147 @@ private:
   virtual void DoSetDirection (const uint8_t direction);
   virtual int64_t DoAssignStreams (int64_t);
 
-  bool is_intersection(Vector speed, Vector nextPosition, Vector position);
-  bool is_changeRN(Vector speed, Vector nextPosition, Vector position);
-  void ChangeVelocity(Vector speed, Vector nextPosition, Vector position);
-  void ChangeRN(Vector speed, Vector nextPosition, Vector position);
-  int ChangedDirection();
-  Vector InputVelocity();
-  Vector DirVelocity(Vector velocity);
+  /**
+   * \brief Turn onto the crossing road at the end of a walk step
+   * \param offset the offset along the road at the start of the step
+   * \param next the offset at its end
+   */
+  void ChangeVelocity(double offset, double next);
+  /**
+   * \brief Move to the lane of the next turn at the end of a walk step
+   * \param offset the offset along the road at the start of the step
+   */
+  void ChangeRN(double offset);
+  /**
+   * \return the turn to take at the next intersection
+   */
+  int ChangedDirection(void);
+  /**
+   * \return a new speed, with the next turn encoded in its third decimal
+   */
+  double DrawSpeed (void);
 
-  double CalPercent(double a, double b);
+  double CalPercent(double a);
 
-  ConstantVelocityHelper m_helper; //!< helper for this object
-  EventId m_event; //!< stored event ID
-  Ptr<RandomVariableStream> m_speed; //!< rv for picking speed
-  Rectangle m_bounds; //!< Bounds of the area to cruise
-  uint32_t m_grid;
-  uint32_t m_intersection;
-  double m_distance;
-  double m_delta;
+  /**
+   * \param offset an offset along the road, from the start of block m_place.block
+   * \return the position of the vehicle at that offset on its lane
+   */
+  Vector GetRoadPosition (double offset) const;
+  /**
+   * \return the offset along the road of the vehicle now, from the start
+   *         of block m_place.block
+   */
+  double GetCurrentOffset (void) const;
+  /**
+   * Move m_place.offset to the current time and into the block it is in.
+   */
+  void Advance (void);
+  /**
+   * Notify CourseChange, no sooner than MinCourseChangeInterval after the
+   * last notification.
+   */
+  void DoNotifyCourseChange (void);
+
+  /**
+   * The attributes of a model that do not change while it drives. Models
+   * copied by IntersectionsHelper share them; setting an attribute on one
+   * of them gives it a configuration of its own first.
+   */
+  struct Config : public SimpleRefCount<Config>
+  {
+    Config ();
+
+    Rectangle bounds; //!< Bounds of the area to cruise
+    Ptr<RandomVariableStream> speed; //!< distribution of the speed
+    double minSpeed; //!< low end of a Constant or Uniform speed
+    double maxSpeed; //!< high end of a Constant or Uniform speed
+    bool sharedSpeed; //!< the speed is neither Constant nor Uniform: drawn from the variable itself
+    uint64_t seed; //!< key of the random streams of the vehicles
+    Ptr<RoadGrid> roadGrid; //!< road layout
+    Ptr<TurnPool> turnPool; //!< pool of the Markov turn counters
+    Ptr<TurnMatrix> turnMatrix; //!< turning ratios by intersection, used instead of the counters if set
+    Time minNotifyInterval; //!< minimum time between two notifications
+    double distance; //!< Distance between intersections, without a RoadGrid
+    double delta; //!< bound of the speed offsets
+    uint32_t grid; //!< number of lanes, without a RoadGrid
+    uint32_t intersection; //!< number of intersections, without a RoadGrid
+    bool eventDriven; //!< schedule only the steps where something happens
+    bool coalesce; //!< notify CourseChange only when the course really changed
+  };
+
+  /**
+   * \return the configuration of this model, which it no longer shares
+   */
+  Config &GetOwnConfig (void);
+
+  // attribute accessors of the configuration
+  void SetGrid (uint32_t grid);
+  uint32_t GetGrid (void) const;
+  void SetIntersection (uint32_t intersection);
+  uint32_t GetIntersection (void) const;
+  void SetDistance (double distance);
+  double GetDistance (void) const;
+  void SetSpeed (Ptr<RandomVariableStream> speed);
+  Ptr<RandomVariableStream> GetSpeed (void) const;
+  void SetSeed (uint64_t seed);
+  uint64_t GetSeed (void) const;
+  void SetBounds (Rectangle bounds);
+  Rectangle GetBounds (void) const;
+  void SetDeltaSpeed (double delta);
+  double GetDeltaSpeed (void) const;
+  void SetEventDriven (bool eventDriven);
+  bool GetEventDriven (void) const;
+  void SetCoalesce (bool coalesce);
+  bool GetCoalesce (void) const;
+  void SetMinCourseChangeInterval (Time interval);
+  Time GetMinCourseChangeInterval (void) const;
+  void SetTurnPool (Ptr<TurnPool> turnPool);
+  Ptr<TurnPool> GetTurnPool (void) const;
+  void SetTurnMatrix (Ptr<TurnMatrix> turnMatrix);
+  Ptr<TurnMatrix> GetTurnMatrix (void) const;
+
+  Ptr<Config> m_config; //!< configuration, possibly shared
   double m_deltaspeed;
-  bool b_init = true;
 
-  int n_r;
-  int direction;
+  // the vehicle drives on a lane of its road, at an offset along it; its
+  // position is only computed from these when it is asked for, so it
+  // stays on the lane centre-line
+  RoadGrid::Place m_place; //!< where the vehicle is at m_offsetTime, with its heading and next turn
+  double m_speed; //!< speed along the heading
+  Time m_offsetTime; //!< time of m_place.offset
+  union
+  {
+    TurnCounts m_turns; //!< Markov turn counters of this vehicle, without a TurnMatrix
+    uint32_t m_turnSet; //!< TurnMatrix entry of its next turn, with one
+  };
+
+  // the rest of the state of the walk, packed in 32 bits
+  uint32_t b_init : 1; //!< the first step is still to come
+  uint32_t b_poll : 1; //!< walk a single step even in event-driven mode
+  uint32_t m_started : 1; //!< the start state was drawn, by DoInitialize or ahead of it by IntersectionsHelper
+  uint32_t m_courseChanged : 1; //!< the course changed since the last notification
+  uint32_t m_constantSpeed : 1; //!< the Speed draws the same value every time, so EventDriven can skip steps
+  mutable uint32_t m_positionValid : 1; //!< false once the course changed since m_position was computed
+
+  EventId m_event; //!< stored event ID
+  PhiloxStream m_rng; //!< random stream of the vehicle, keyed when the start state is drawn
+  uint64_t m_stream; //!< number of the random stream, automatic or set by AssignStreams
+
+  Time m_nextNotify; //!< earliest time of the next notification
+  EventId m_notifyEvent; //!< pending throttled notification
 
-  bool b_st = false;
-  bool b_rn = false;
+  mutable Vector m_position; //!< position computed at m_positionTime; until the start state is drawn, the position set
+  mutable Time m_positionTime; //!< time m_position was computed at
+  mutable uint64_t m_positionQueries; //!< number of DoGetPosition calls
+  mutable uint64_t m_positionHits; //!< number of DoGetPosition calls answered from m_position
+  uint64_t m_walkSteps; //!< number of walk step events scheduled
+  uint64_t m_straightTurns; //!< number of intersections crossed going straight
+  uint64_t m_rightTurns; //!< number of right turns
+  uint64_t m_leftTurns; //!< number of left turns
+  uint64_t m_laneChanges; //!< number of ChangeRN steps
+  uint64_t m_rebounds; //!< number of rebounds on the bounds
+  ns3::TracedCallback<const Counters &> m_countersTrace; //!< counters of the model when it is disposed
 
 };
 
@@ -0,0 +1,108 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "latency-histogram.h"
+#include "ns3/simulator.h"
+#include <iomanip>
+#include <iostream>
+
+namespace ns3 {
+
+// the registered histograms, most recent first
+static std::atomic<LatencyHistogram *> g_histograms (0);
+// a dump is scheduled at the destruction of the simulator
+static bool g_dumpScheduled = false;
+
+LatencyHistogram::LatencyHistogram (const char *name)
+  : m_name (name),
+    m_count (0),
+    m_sum (0),
+    m_max (0)
+{
+  for (uint32_t b = 0; b < BUCKETS; b++)
+    {
+      m_buckets[b].store (0, std::memory_order_relaxed);
+    }
+  m_next = g_histograms.load ();
+  while (!g_histograms.compare_exchange_weak (m_next, this))
+    {
+    }
+}
+
+void
+LatencyHistogram::Print (std::ostream &os) const
+{
+  static const double percents[] = { 50, 90, 99, 99.9 };
+  uint64_t count = m_count.load (std::memory_order_relaxed);
+  os << std::left << std::setw (36) << m_name << std::right
+     << " n=" << count;
+  if (count == 0)
+    {
+      os << std::endl;
+      return;
+    }
+  os << " mean=" << m_sum.load (std::memory_order_relaxed) / count;
+  uint32_t b = 0;
+  uint64_t below = m_buckets[0].load (std::memory_order_relaxed);
+  for (uint32_t p = 0; p < sizeof (percents) / sizeof (percents[0]); p++)
+    {
+      while (below < count * percents[p] / 100 && b + 1 < BUCKETS)
+        {
+          b++;
+          below += m_buckets[b].load (std::memory_order_relaxed);
+        }
+      os << " p" << percents[p] << "<" << (b + 1 < BUCKETS ? (uint64_t) 2 << b : ~(uint64_t) 0);
+    }
+  os << " max=" << m_max.load (std::memory_order_relaxed) << " ns" << std::endl;
+}
+
+void
+LatencyHistogram::PrintAll (std::ostream &os)
+{
+  for (LatencyHistogram *h = g_histograms.load (); h != 0; h = h->m_next)
+    {
+      h->Print (os);
+    }
+}
+
+void
+LatencyHistogram::ScheduleDump (void)
+{
+  if (!g_dumpScheduled)
+    {
+      g_dumpScheduled = true;
+      Simulator::ScheduleDestroy (&LatencyHistogram::Dump);
+    }
+}
+
+void
+LatencyHistogram::Dump (void)
+{
+  PrintAll (std::clog);
+  // start over for the next simulation
+  for (LatencyHistogram *h = g_histograms.load (); h != 0; h = h->m_next)
+    {
+      for (uint32_t b = 0; b < BUCKETS; b++)
+        {
+          h->m_buckets[b].store (0, std::memory_order_relaxed);
+        }
+      h->m_count.store (0, std::memory_order_relaxed);
+      h->m_sum.store (0, std::memory_order_relaxed);
+      h->m_max.store (0, std::memory_order_relaxed);
+    }
+  g_dumpScheduled = false;
+}
+
+} // namespace ns3
@@ -0,0 +1,141 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief A histogram of durations, in power of two buckets of nanoseconds.
+ *
+ * Add only does relaxed atomic increments, so a histogram can be fed from
+ * several threads without a lock. Every histogram registers itself on
+ * construction; PrintAll prints the count, mean, percentiles and maximum
+ * of each one. The percentiles are the upper bounds of their buckets,
+ * so they are within a factor of two above the true value.
+ *
+ * The histograms are meant to be used through INTERSECTIONS_PROFILE_SCOPE,
+ * which compiles to nothing unless INTERSECTIONS_PROFILE is defined.
+ */
+class LatencyHistogram
+{
+public:
+  /**
+   * \param name the name printed with the histogram, kept by pointer
+   */
+  LatencyHistogram (const char *name);
+
+  /**
+   * \param ns a duration in nanoseconds
+   */
+  void Add (uint64_t ns);
+  /**
+   * \param os the stream to print the histogram to
+   */
+  void Print (std::ostream &os) const;
+
+  /**
+   * \param os the stream to print every histogram to
+   */
+  static void PrintAll (std::ostream &os);
+  /**
+   * Make sure the histograms are printed to std::clog when the simulator
+   * is destroyed. Cheap enough to be called once per model.
+   */
+  static void ScheduleDump (void);
+
+private:
+  /** Print every histogram to std::clog. */
+  static void Dump (void);
+
+  static const uint32_t BUCKETS = 64; //!< one bucket per bit of a duration
+
+  const char *m_name; //!< name of the histogram
+  std::atomic<uint64_t> m_buckets[BUCKETS]; //!< bucket b counts the durations in [2^b, 2^(b+1)) ns
+  std::atomic<uint64_t> m_count; //!< number of durations
+  std::atomic<uint64_t> m_sum; //!< sum of the durations
+  std::atomic<uint64_t> m_max; //!< longest duration
+  LatencyHistogram *m_next; //!< next registered histogram
+};
+
+/**
+ * \ingroup mobility
+ * \brief Adds the time from its construction to its destruction to a histogram.
+ */
+class ScopedLatency
+{
+public:
+  /**
+   * \param histogram the histogram to add to
+   */
+  ScopedLatency (LatencyHistogram &histogram)
+    : m_histogram (histogram),
+      m_start (std::chrono::steady_clock::now ())
+  {
+  }
+  ~ScopedLatency ()
+  {
+    std::chrono::steady_clock::duration d = std::chrono::steady_clock::now () - m_start;
+    m_histogram.Add (std::chrono::duration_cast<std::chrono::nanoseconds> (d).count ());
+  }
+
+private:
+  LatencyHistogram &m_histogram; //!< histogram to add to
+  std::chrono::steady_clock::time_point m_start; //!< construction time
+};
+
+inline void
+LatencyHistogram::Add (uint64_t ns)
+{
+  uint32_t b = ns > 0 ? 63 - __builtin_clzll (ns) : 0;
+  m_buckets[b].fetch_add (1, std::memory_order_relaxed);
+  m_count.fetch_add (1, std::memory_order_relaxed);
+  m_sum.fetch_add (ns, std::memory_order_relaxed);
+  uint64_t max = m_max.load (std::memory_order_relaxed);
+  while (ns > max && !m_max.compare_exchange_weak (max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+} // namespace ns3
+
+#ifdef INTERSECTIONS_PROFILE
+#define INTERSECTIONS_PROFILE_CONCAT2(a, b) a ## b
+#define INTERSECTIONS_PROFILE_CONCAT(a, b) INTERSECTIONS_PROFILE_CONCAT2 (a, b)
+/**
+ * \ingroup mobility
+ * Time the rest of the enclosing scope into the histogram called name.
+ */
+#define INTERSECTIONS_PROFILE_SCOPE(name)                                             \
+  static ns3::LatencyHistogram INTERSECTIONS_PROFILE_CONCAT (latencyHistogram, __LINE__) (name); \
+  ns3::ScopedLatency INTERSECTIONS_PROFILE_CONCAT (scopedLatency, __LINE__) (INTERSECTIONS_PROFILE_CONCAT (latencyHistogram, __LINE__))
+/**
+ * \ingroup mobility
+ * Print the histograms when the simulator is destroyed.
+ */
+#define INTERSECTIONS_PROFILE_DUMP() ns3::LatencyHistogram::ScheduleDump ()
+#else
+#define INTERSECTIONS_PROFILE_SCOPE(name)
+#define INTERSECTIONS_PROFILE_DUMP()
+#endif
+
+#endif /* LATENCY_HISTOGRAM_H */
@@ -0,0 +1,162 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "parallel-for.h"
+#include "ns3/log.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ParallelFor");
+
+namespace {
+
+/** The chunks [begin, end) a thread has left. */
+struct Share
+{
+  std::mutex mutex;   //!< guards begin and end
+  uint32_t begin;     //!< next chunk the owner takes
+  uint32_t end;       //!< one past the last chunk, where thieves take from
+  char pad[64];       //!< keeps the shares on separate cache lines
+};
+
+/**
+ * \param shares the shares of all the threads
+ * \param self the index of the calling thread
+ * \param chunk set to the chunk to run
+ * \return false once no share has chunks left
+ */
+bool
+Take (std::vector<Share> &shares, uint32_t self, uint32_t &chunk)
+{
+  Share &own = shares[self];
+  {
+    std::lock_guard<std::mutex> lock (own.mutex);
+    if (own.begin < own.end)
+      {
+        chunk = own.begin++;
+        return true;
+      }
+  }
+
+  while (true)
+    {
+      // the sizes may change under us, the steal checks again
+      uint32_t victim = self;
+      uint32_t largest = 0;
+      for (uint32_t t = 0; t < shares.size (); t++)
+        {
+          std::lock_guard<std::mutex> lock (shares[t].mutex);
+          uint32_t left = shares[t].end - shares[t].begin;
+          if (t != self && left > largest)
+            {
+              victim = t;
+              largest = left;
+            }
+        }
+      if (victim == self)
+        {
+          return false;
+        }
+
+      uint32_t begin;
+      uint32_t end;
+      {
+        std::lock_guard<std::mutex> lock (shares[victim].mutex);
+        Share &s = shares[victim];
+        if (s.begin == s.end)
+          {
+            continue;
+          }
+        end = s.end;
+        begin = end - (end - s.begin + 1) / 2;
+        s.end = begin;
+      }
+      std::lock_guard<std::mutex> lock (own.mutex);
+      own.begin = begin + 1;
+      own.end = end;
+      chunk = begin;
+      return true;
+    }
+}
+
+/**
+ * Run chunks until there are none left.
+ */
+void
+Work (std::vector<Share> *shares, uint32_t self, uint32_t n, uint32_t grain,
+      void (*run)(void *, uint32_t, uint32_t), void *context)
+{
+  uint32_t chunk;
+  while (Take (*shares, self, chunk))
+    {
+      uint32_t begin = chunk * grain;
+      run (context, begin, begin + std::min (n - begin, grain));
+    }
+}
+
+} // anonymous namespace
+
+uint32_t
+GetHardwareThreads (void)
+{
+  return std::max (std::thread::hardware_concurrency (), 1u);
+}
+
+uint32_t
+ParallelFor (uint32_t n, uint32_t threads, uint32_t grain,
+             void (*run)(void *context, uint32_t begin, uint32_t end), void *context)
+{
+  NS_LOG_FUNCTION (n << threads << grain);
+  grain = std::max (grain, 1u);
+  uint32_t chunks = n / grain + (n % grain != 0);
+  if (threads == 0)
+    {
+      threads = GetHardwareThreads ();
+    }
+  threads = std::min (threads, chunks);
+  if (threads <= 1)
+    {
+      if (n > 0)
+        {
+          run (context, 0, n);
+        }
+      return 1;
+    }
+
+  std::vector<Share> shares (threads);
+  for (uint32_t t = 0; t < threads; t++)
+    {
+      shares[t].begin = (uint64_t) chunks * t / threads;
+      shares[t].end = (uint64_t) chunks * (t + 1) / threads;
+    }
+
+  std::vector<std::thread> workers;
+  for (uint32_t t = 1; t < threads; t++)
+    {
+      workers.push_back (std::thread (&Work, &shares, t, n, grain, run, context));
+    }
+  Work (&shares, 0, n, grain, run, context);
+  for (uint32_t t = 0; t < workers.size (); t++)
+    {
+      workers[t].join ();
+    }
+  return threads;
+}
+
+} // namespace ns3
@@ -0,0 +1,50 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Run a function over ranges of [0, n) on several threads
+ *
+ * [0, n) is cut into chunks of grain items, and each thread starts with
+ * an equal share of the chunks. A thread that runs out of chunks steals
+ * the back half of the largest share left, so threads that got slow
+ * items do not hold up the others. The calling thread is one of the
+ * threads. The function must only touch what belongs to its range.
+ *
+ * \param n the number of items
+ * \param threads the number of threads, 0 for one per hardware thread
+ * \param grain the number of items of a chunk
+ * \param run called with context and each chunk [begin, end)
+ * \param context passed to run
+ * \return the number of threads used
+ */
+uint32_t ParallelFor (uint32_t n, uint32_t threads, uint32_t grain,
+                      void (*run)(void *context, uint32_t begin, uint32_t end), void *context);
+
+/**
+ * \return the number of threads ParallelFor uses for threads = 0
+ */
+uint32_t GetHardwareThreads (void);
+
+} // namespace ns3
+
+#endif /* PARALLEL_FOR_H */
@@ -0,0 +1,116 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11).
+ *
+ * The n-th block of 128 bits of a stream is a function of the seed, the
+ * stream number and n only. Streams need no shared state, so one per
+ * vehicle can be drawn from any thread, in any order, with the same
+ * values. A stream splits into 2^32 substreams of 2^33 values each, the
+ * substream being the high half of the block index.
+ */
+class PhiloxStream
+{
+public:
+  /**
+   * \param seed the seed, shared by all the streams of a run
+   * \param stream the number of the stream
+   * \param substream the number of the substream
+   */
+  PhiloxStream (uint64_t seed, uint64_t stream, uint32_t substream = 0)
+    : m_next ((uint64_t) substream << 32),
+      m_used (2)
+  {
+    m_key[0] = (uint32_t) seed;
+    m_key[1] = (uint32_t) (seed >> 32);
+    m_stream[0] = (uint32_t) stream;
+    m_stream[1] = (uint32_t) (stream >> 32);
+  }
+
+  /**
+   * \param key the key: the seed
+   * \param counter the counter: block index and stream number
+   * \param block set to the 128 random bits of the counter
+   */
+  static void Generate (const uint32_t key[2], const uint32_t counter[4], uint32_t block[4])
+  {
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    uint32_t c0 = counter[0];
+    uint32_t c1 = counter[1];
+    uint32_t c2 = counter[2];
+    uint32_t c3 = counter[3];
+    for (int round = 0; round < 10; round++)
+      {
+        uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+        uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t) p1;
+        c3 = (uint32_t) p0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+      }
+    block[0] = c0;
+    block[1] = c1;
+    block[2] = c2;
+    block[3] = c3;
+  }
+
+  /**
+   * \return a uniform value in [0, 1), with 53 random bits
+   */
+  double GetValue (void)
+  {
+    if (m_used == 2)
+      {
+        uint32_t counter[4] = { (uint32_t) m_next, (uint32_t) (m_next >> 32), m_stream[0], m_stream[1] };
+        Generate (m_key, counter, m_block);
+        m_next++;
+        m_used = 0;
+      }
+    const uint32_t *w = m_block + 2 * m_used++;
+    return ((w[0] >> 5) * 67108864.0 + (w[1] >> 6)) * (1.0 / 9007199254740992.0);
+  }
+  /**
+   * \param min the low end of the range
+   * \param max the high end of the range
+   * \return a uniform value in [min, max)
+   */
+  double GetValue (double min, double max)
+  {
+    return min + (max - min) * GetValue ();
+  }
+
+private:
+  uint32_t m_key[2];    //!< the seed
+  uint32_t m_stream[2]; //!< the stream number, high half of the counter
+  uint64_t m_next;      //!< index of the next block, low half of the counter
+  uint32_t m_block[4];  //!< the current block
+  uint8_t m_used;       //!< values of m_block already returned, out of 2
+};
+
+} // namespace ns3
+
+#endif /* PHILOX_H */
@@ -18,13 +18,23 @@
  * Author: Mathieu Lacage <mathieu.lacage@sophia.inria.fr>
  */
 #include "position-allocator.h"
+#include "philox.h"
 #include "ns3/double.h"
 #include "ns3/string.h"
 #include "ns3/pointer.h"
 #include "ns3/uinteger.h"
 #include "ns3/enum.h"
 #include "ns3/log.h"
+#include "ns3/abort.h"
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace ns3 {
 
@@ -49,6 +59,22 @@ PositionAllocator::~PositionAllocator ()
 {
 }
 
+void
+PositionAllocator::GetNextBatch (Vector *positions, uint32_t n) const
+{
+  for (uint32_t i = 0; i < n; i++)
+    {
+      positions[i] = GetNext ();
+    }
+}
+
+Vector
+PositionAllocator::GetAt (uint32_t /* i */) const
+{
+  NS_FATAL_ERROR (GetInstanceTypeId ().GetName () << " has no GetAt");
+  return Vector ();
+}
+
 NS_OBJECT_ENSURE_REGISTERED (ListPositionAllocator);
 
 TypeId
@@ -93,6 +119,183 @@ ListPositionAllocator::GetSize (void) const
   return m_positions.size ();
 }
 
+NS_OBJECT_ENSURE_REGISTERED (FileListPositionAllocator);
+
+static const char g_positionListMagic[8] = { 'M', 'K', 'V', 'P', 'O', 'S', '0', '1' };
+
+TypeId
+FileListPositionAllocator::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::FileListPositionAllocator")
+    .SetParent<PositionAllocator> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<FileListPositionAllocator> ()
+    .AddAttribute ("Filename", "The position list file to map.",
+                   StringValue (""),
+                   MakeStringAccessor (&FileListPositionAllocator::Open,
+                                       &FileListPositionAllocator::GetFilename),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+FileListPositionAllocator::FileListPositionAllocator ()
+  : m_data (0),
+    m_size (0),
+    m_positions (0),
+    m_n (0),
+    m_current (0)
+{
+}
+
+FileListPositionAllocator::~FileListPositionAllocator ()
+{
+  Close ();
+}
+
+void
+FileListPositionAllocator::DoDispose (void)
+{
+  Close ();
+  PositionAllocator::DoDispose ();
+}
+
+void
+FileListPositionAllocator::Close (void)
+{
+  if (m_data != 0)
+    {
+      munmap ((void *) m_data, m_size);
+      m_data = 0;
+      m_size = 0;
+      m_positions = 0;
+      m_n = 0;
+    }
+}
+
+void
+FileListPositionAllocator::Open (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  // the positions are handed out in place
+  static_assert (sizeof (Vector) == 3 * sizeof (double), "Vector is not three doubles");
+  Close ();
+  m_filename = filename;
+  m_current = 0;
+  if (filename.empty ())
+    {
+      return;
+    }
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      NS_FATAL_ERROR ("FileListPositionAllocator: cannot open " << filename);
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (uint64_t) st.st_size < sizeof (PositionListHeader))
+    {
+      close (fd);
+      NS_FATAL_ERROR ("FileListPositionAllocator: " << filename << " is not a position list");
+    }
+  void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      NS_FATAL_ERROR ("FileListPositionAllocator: cannot map " << filename);
+    }
+  // GetNext reads the positions in order
+  madvise (data, st.st_size, MADV_SEQUENTIAL);
+  m_data = (const uint8_t *) data;
+  m_size = st.st_size;
+
+  PositionListHeader header;
+  std::memcpy (&header, m_data, sizeof (header));
+  if (std::memcmp (header.magic, g_positionListMagic, sizeof (g_positionListMagic)) != 0
+      || header.positions > (m_size - sizeof (header)) / sizeof (Vector))
+    {
+      Close ();
+      NS_FATAL_ERROR ("FileListPositionAllocator: " << filename << " is not a position list");
+    }
+  if (header.positions > 0xffffffff)
+    {
+      Close ();
+      NS_FATAL_ERROR ("FileListPositionAllocator: " << filename << " has more than 2^32-1 positions");
+    }
+  m_positions = (const Vector *) (m_data + sizeof (header));
+  m_n = header.positions;
+}
+
+std::string
+FileListPositionAllocator::GetFilename (void) const
+{
+  return m_filename;
+}
+
+uint32_t
+FileListPositionAllocator::GetSize (void) const
+{
+  return m_n;
+}
+
+void
+FileListPositionAllocator::Write (std::string filename, const std::vector<Vector> &positions)
+{
+  NS_LOG_FUNCTION (filename << positions.size ());
+  std::ofstream file (filename.c_str (), std::ios::binary | std::ios::trunc);
+  if (!file.is_open ())
+    {
+      NS_FATAL_ERROR ("FileListPositionAllocator: cannot open " << filename);
+    }
+  PositionListHeader header;
+  std::memcpy (header.magic, g_positionListMagic, sizeof (header.magic));
+  header.positions = positions.size ();
+  file.write ((const char *) &header, sizeof (header));
+  if (!positions.empty ())
+    {
+      file.write ((const char *) &positions[0], positions.size () * sizeof (Vector));
+    }
+  if (!file)
+    {
+      NS_FATAL_ERROR ("FileListPositionAllocator: cannot write " << filename);
+    }
+}
+
+Vector
+FileListPositionAllocator::GetNext (void) const
+{
+  NS_ABORT_MSG_IF (m_n == 0, "FileListPositionAllocator: no positions in \"" << m_filename << "\"");
+  Vector v = m_positions[m_current];
+  m_current = m_current + 1 < m_n ? m_current + 1 : 0;
+  return v;
+}
+
+void
+FileListPositionAllocator::GetNextBatch (Vector *positions, uint32_t n) const
+{
+  NS_ABORT_MSG_IF (m_n == 0 && n > 0, "FileListPositionAllocator: no positions in \"" << m_filename << "\"");
+  while (n > 0)
+    {
+      uint32_t k = std::min (n, m_n - m_current);
+      std::memcpy (positions, m_positions + m_current, k * sizeof (Vector));
+      positions += k;
+      n -= k;
+      m_current = m_current + k < m_n ? m_current + k : 0;
+    }
+}
+
+Vector
+FileListPositionAllocator::GetAt (uint32_t i) const
+{
+  NS_ABORT_MSG_IF (i >= m_n, "FileListPositionAllocator: no position " << i << " in \"" << m_filename << "\"");
+  return m_positions[i];
+}
+
+int64_t
+FileListPositionAllocator::AssignStreams (int64_t stream)
+{
+  return 0;
+}
+
 NS_OBJECT_ENSURE_REGISTERED (GridPositionAllocator);
 
 TypeId 
@@ -199,19 +402,26 @@ GridPositionAllocator::GetLayoutType (void) const
 
 Vector
 GridPositionAllocator::GetNext (void) const
+{
+  Vector position = GetAt (m_current);
+  m_current++;
+  return position;
+}
+
+Vector
+GridPositionAllocator::GetAt (uint32_t i) const
 {
   double x = 0.0, y = 0.0;
   switch (m_layoutType) {
     case ROW_FIRST:
-      x = m_xMin + m_deltaX * (m_current % m_n);
-      y = m_yMin + m_deltaY * (m_current / m_n);
+      x = m_xMin + m_deltaX * (i % m_n);
+      y = m_yMin + m_deltaY * (i / m_n);
       break;
     case COLUMN_FIRST:
-      x = m_xMin + m_deltaX * (m_current / m_n);
-      y = m_yMin + m_deltaY * (m_current % m_n);
+      x = m_xMin + m_deltaX * (i / m_n);
+      y = m_yMin + m_deltaY * (i % m_n);
       break;
     }
-  m_current++;
   return Vector (x, y, 0.0);
 }
 
@@ -501,6 +711,10 @@ UniformDiscPositionAllocator::AssignStreams (int64_t stream)
   return 1;
 }
 
+// the GetAt streams are numbered from here, apart from the vehicle
+// streams of IntersectionsBatch, which are numbered by vehicle index
+static const uint64_t g_positionStreams = (uint64_t) 1 << 32;
+
 NS_OBJECT_ENSURE_REGISTERED (AIntersectionPosition);
 
 TypeId
@@ -518,6 +732,10 @@ AIntersectionPosition::GetTypeId (void)
                    DoubleValue (1.0),
                    MakeDoubleAccessor (&AIntersectionPosition::m_bound),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("Seed", "The seed of the random streams of GetAt.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&AIntersectionPosition::m_seed),
+                   MakeUintegerChecker<uint64_t> ())
    .AddAttribute ("Grid", "The number of line.",
                   UintegerValue (10),
                   MakeUintegerAccessor (&AIntersectionPosition::m_grid),
@@ -528,6 +746,7 @@ AIntersectionPosition::GetTypeId (void)
 AIntersectionPosition::AIntersectionPosition ()
   : m_current (0)
 {
+  m_rv = CreateObject<UniformRandomVariable> ();
 }
 
 void
@@ -567,7 +786,7 @@ AIntersectionPosition::GetNext (void) const
   double x = 0.0, y = 0.0;
   double width = m_grid * 3;
 
-  int r = UniformRandomVariable ().GetValue (0, (m_bound-width)/(m_num/(2*m_grid)));
+  int r = m_rv->GetValue (0, (m_bound-width)/(m_num/(2*m_grid)));
 
   if(m_current <= m_num/2){
     x = (m_bound-width)/2 + 1.5 + 3*(m_current/(m_num/(2*m_grid)));
@@ -582,10 +801,60 @@ AIntersectionPosition::GetNext (void) const
   return Vector (x, y, 0.0);
 }
 
+void
+AIntersectionPosition::GetNextBatch (Vector *positions, uint32_t n) const
+{
+  double width = m_grid * 3;
+  uint32_t per = m_num/(2*m_grid);
+  double spacing = (m_bound-width)/per;
+
+  // the offsets first, in the order GetNext draws them
+  std::vector<double> r (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      r[i] = (int) m_rv->GetValue (0, spacing);
+    }
+
+  for (uint32_t i = 0; i < n; i++)
+    {
+      uint32_t k = m_current + i;
+      bool vertical = k <= m_num/2;
+      if (!vertical)
+        {
+          k -= m_num/2;
+        }
+      double across = (m_bound-width)/2 + 1.5 + 3*(k/per);
+      double along = (k%per) * spacing + r[i] + (k%per)/(per/2) * width;
+      positions[i] = Vector (vertical ? across : along, vertical ? along : across, 0.0);
+    }
+  m_current += n;
+}
+
+Vector
+AIntersectionPosition::GetAt (uint32_t i) const
+{
+  PhiloxStream rng (m_seed, g_positionStreams + i);
+  double width = m_grid * 3;
+  uint32_t per = m_num/(2*m_grid);
+  double spacing = (m_bound-width)/per;
+  int r = rng.GetValue (0, spacing);
+
+  uint32_t k = i;
+  bool vertical = k <= m_num/2;
+  if (!vertical)
+    {
+      k -= m_num/2;
+    }
+  double across = (m_bound-width)/2 + 1.5 + 3*(k/per);
+  double along = (k%per) * spacing + r + (k%per)/(per/2) * width;
+  return Vector (vertical ? across : along, vertical ? along : across, 0.0);
+}
+
 int64_t
 AIntersectionPosition::AssignStreams (int64_t stream)
 {
-  return 0;
+  m_rv->SetStream (stream);
+  return 1;
 }
 
 NS_OBJECT_ENSURE_REGISTERED (IntersectionsPosition);
@@ -601,10 +870,20 @@ IntersectionsPosition::GetTypeId (void)
                    UintegerValue (100),
                    MakeUintegerAccessor (&IntersectionsPosition::m_num),
                    MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("RoadGrid",
+                   "The road layout shared with the mobility model. "
+                   "If set, Grid, Intersection and Distance are taken from it.",
+                   PointerValue (),
+                   MakePointerAccessor (&IntersectionsPosition::m_roadGrid),
+                   MakePointerChecker<RoadGrid> ())
     .AddAttribute ("Distance", "Distance between intersection (m).",
                    DoubleValue (300.0),
                    MakeDoubleAccessor (&IntersectionsPosition::m_bound),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("Seed", "The seed of the random streams of GetAt.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&IntersectionsPosition::m_seed),
+                   MakeUintegerChecker<uint64_t> ())
    .AddAttribute ("Intersection", "The number of intersection n x n.",
                   UintegerValue (1),
                   MakeUintegerAccessor (&IntersectionsPosition::m_intersection),
@@ -619,6 +898,7 @@ IntersectionsPosition::GetTypeId (void)
 IntersectionsPosition::IntersectionsPosition ()
   : m_current (0)
 {
+  m_rv = CreateObject<UniformRandomVariable> ();
 }
 
 void
@@ -655,28 +935,106 @@ IntersectionsPosition::GetN (void) const
 Vector
 IntersectionsPosition::GetNext (void) const
 {
+  CheckRoadGrid ();
+  double size = m_roadGrid->GetBounds ().xMax;
+
   double x = 0.0, y = 0.0;
-  int a = UniformRandomVariable ().GetValue (0, 100 * m_intersection);
-  int b = UniformRandomVariable ().GetValue (0, 100);
-  int c = UniformRandomVariable ().GetValue (0, 100 * m_grid);
+  int a = m_rv->GetValue (0, 100 * m_roadGrid->GetIntersection ());
+  int b = m_rv->GetValue (0, 100);
+  int c = m_rv->GetValue (0, 100 * m_roadGrid->GetGrid ());
   int d = 0;
   if(b < 50) d = 1; else d = -1;
 
   if(m_current < m_num / 2){
-    x = m_bound * (a/100 + 0.5) + d * (3 * (c / 100) + 1.5);
-    y = UniformRandomVariable ().GetValue (0, m_intersection * m_bound);
+    x = m_roadGrid->GetRoadCentre (a/100) + d * m_roadGrid->GetLaneCentre (c/100);
+    y = m_rv->GetValue (0, size);
   } else {
-    x = UniformRandomVariable ().GetValue (0, m_intersection * m_bound);
-    y = m_bound * (a/100 + 0.5) + d * (3 * (c / 100) + 1.5);
+    x = m_rv->GetValue (0, size);
+    y = m_roadGrid->GetRoadCentre (a/100) + d * m_roadGrid->GetLaneCentre (c/100);
   }
 
   m_current++;
   return Vector (x, y, 0.0);
 }
 
+void
+IntersectionsPosition::GetNextBatch (Vector *positions, uint32_t n) const
+{
+  CheckRoadGrid ();
+  double size = m_roadGrid->GetBounds ().xMax;
+  uint32_t intersection = m_roadGrid->GetIntersection ();
+  uint32_t grid = m_roadGrid->GetGrid ();
+  std::vector<double> roads (intersection);
+  for (uint32_t i = 0; i < intersection; i++)
+    {
+      roads[i] = m_roadGrid->GetRoadCentre (i);
+    }
+  std::vector<double> lanes (grid);
+  for (uint32_t i = 0; i < grid; i++)
+    {
+      lanes[i] = m_roadGrid->GetLaneCentre (i);
+    }
+
+  // four draws per position, in the order GetNext makes them; a chunk at
+  // a time so the draws stay in cache
+  static const uint32_t chunk = 1024;
+  double u[4 * chunk];
+  for (uint32_t begin = 0; begin < n; begin += chunk)
+    {
+      uint32_t end = std::min (n, begin + chunk);
+      for (uint32_t k = 0; k < 4 * (end - begin); k += 4)
+        {
+          u[k] = m_rv->GetValue (0, 100 * intersection);
+          u[k + 1] = m_rv->GetValue (0, 100);
+          u[k + 2] = m_rv->GetValue (0, 100 * grid);
+          u[k + 3] = m_rv->GetValue (0, size);
+        }
+      for (uint32_t i = begin; i < end; i++)
+        {
+          const double *d = &u[4 * (i - begin)];
+          int a = d[0];
+          int b = d[1];
+          int c = d[2];
+          double across = roads[a/100] + (b < 50 ? 1 : -1) * lanes[c/100];
+          bool vertical = m_current + i < m_num / 2;
+          positions[i] = Vector (vertical ? across : d[3], vertical ? d[3] : across, 0.0);
+        }
+    }
+  m_current += n;
+}
+
+Vector
+IntersectionsPosition::GetAt (uint32_t i) const
+{
+  CheckRoadGrid ();
+  PhiloxStream rng (m_seed, g_positionStreams + i);
+  double size = m_roadGrid->GetBounds ().xMax;
+  int a = rng.GetValue (0, 100 * m_roadGrid->GetIntersection ());
+  int b = rng.GetValue (0, 100);
+  int c = rng.GetValue (0, 100 * m_roadGrid->GetGrid ());
+  double along = rng.GetValue (0, size);
+  double across = m_roadGrid->GetRoadCentre (a/100) + (b < 50 ? 1 : -1) * m_roadGrid->GetLaneCentre (c/100);
+  bool vertical = i < m_num / 2;
+  return Vector (vertical ? across : along, vertical ? along : across, 0.0);
+}
+
+void
+IntersectionsPosition::CheckRoadGrid (void) const
+{
+  if (m_roadGrid == 0)
+    {
+      // no shared layout: build one from our own attributes
+      m_roadGrid = CreateObject<RoadGrid> ();
+      m_roadGrid->SetGrid (m_grid);
+      m_roadGrid->SetIntersection (m_intersection);
+      m_roadGrid->SetDistance (m_bound);
+    }
+}
+
 int64_t
 IntersectionsPosition::AssignStreams (int64_t stream)
 {
-  return 0;
+  m_rv->SetStream (stream);
+  return 1;
 }
 } // namespace ns3 
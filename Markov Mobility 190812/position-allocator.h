@@ -23,6 +23,9 @@
 #include "ns3/object.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/vector.h"
+#include "road-grid.h"
+#include <string>
+#include <vector>
 
 namespace ns3 {
 
@@ -48,6 +51,29 @@ public:
    * This method _must_ be implement in subclasses.
    */
   virtual Vector GetNext (void) const = 0;
+  /**
+   * \brief Get the next n positions at once
+   *
+   * The positions are the ones n calls to GetNext would return. Subclasses
+   * may override this to make the positions in a single pass; by default
+   * GetNext is called n times.
+   *
+   * \param positions the array to fill, of at least n positions
+   * \param n the number of positions
+   */
+  virtual void GetNextBatch (Vector *positions, uint32_t n) const;
+  /**
+   * \brief Get a position by its index
+   *
+   * Unlike GetNext, the position depends only on the index and on the
+   * attributes of the allocator, so the positions of a layout can be
+   * made in any order, on any number of threads or processes, with the
+   * same result. Only some allocators support it; the others abort.
+   *
+   * \param i the index of the position
+   * \return the position
+   */
+  virtual Vector GetAt (uint32_t i) const;
   /**
    * Assign a fixed random variable stream number to the random variables
    * used by this model. Return the number of streams (possibly zero) that
@@ -98,6 +124,85 @@ private:
   mutable std::vector<Vector>::const_iterator m_current; //!< vector iterator
 };
 
+/**
+ * \ingroup mobility
+ * Header of a position list file.
+ *
+ * The file is little-endian and made of this header followed by the
+ * positions, three doubles x, y and z each, which is the layout of a
+ * Vector. position-list-tool converts CSV files to it.
+ */
+struct PositionListHeader
+{
+  char magic[8];          //!< "MKVPOS01"
+  uint64_t positions;     //!< number of positions
+};
+
+/**
+ * \ingroup mobility
+ * \brief Allocate positions from a position list file mapped in memory.
+ *
+ * Like ListPositionAllocator, the first call to GetNext returns the first
+ * position of the file, the second call the second one, and so on, and
+ * the list starts over at its end. The positions are not read or copied
+ * when the file is opened: they are returned straight from the mapped
+ * file, whose pages are only loaded when they are read, so opening a file
+ * takes the same time and memory whatever its size.
+ */
+class FileListPositionAllocator : public PositionAllocator
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  FileListPositionAllocator ();
+  virtual ~FileListPositionAllocator ();
+
+  /**
+   * \param filename the position list file to map
+   */
+  void Open (std::string filename);
+  /**
+   * \return the name of the mapped file
+   */
+  std::string GetFilename (void) const;
+  /**
+   * \return the number of positions in the file
+   */
+  uint32_t GetSize (void) const;
+
+  /**
+   * \brief Write a position list file
+   * \param filename the file to write
+   * \param positions the positions to write
+   */
+  static void Write (std::string filename, const std::vector<Vector> &positions);
+
+  virtual Vector GetNext (void) const;
+  virtual void GetNextBatch (Vector *positions, uint32_t n) const;
+  /**
+   * \param i the index of a position in the file
+   * \return the position
+   */
+  virtual Vector GetAt (uint32_t i) const;
+  virtual int64_t AssignStreams (int64_t stream);
+private:
+  virtual void DoDispose (void);
+  /**
+   * Unmap the file.
+   */
+  void Close (void);
+
+  std::string m_filename;     //!< name of the mapped file
+  const uint8_t *m_data;      //!< the mapped file
+  uint64_t m_size;            //!< size of the mapped file
+  const Vector *m_positions;  //!< positions of the mapped file
+  uint32_t m_n;               //!< number of positions
+  mutable uint32_t m_current; //!< index of the next position
+};
+
 /**
  * \ingroup mobility
  * \brief Allocate positions on a rectangular 2d grid.
@@ -184,6 +289,11 @@ public:
 
 
   virtual Vector GetNext (void) const;
+  /**
+   * \param i the index of the position
+   * \return the position the i-th call to GetNext returns
+   */
+  virtual Vector GetAt (uint32_t i) const;
   virtual int64_t AssignStreams (int64_t stream);
 private:
   mutable uint32_t m_current; //!< currently position
@@ -386,9 +496,23 @@ public:
 
 
   virtual Vector GetNext (void) const;
+  /**
+   * Draws the random offsets first, then computes the positions in a loop
+   * without calls.
+   */
+  virtual void GetNextBatch (Vector *positions, uint32_t n) const;
+  /**
+   * Position i is laid out like the i-th position of GetNext, with its
+   * random offset drawn from a PhiloxStream keyed by Seed and i. The
+   * layout is the same whatever the order of the calls, but it is not
+   * the one of GetNext, which draws from the ns-3 random streams.
+   */
+  virtual Vector GetAt (uint32_t i) const;
   virtual int64_t AssignStreams (int64_t stream);
 private:
   mutable uint32_t m_current; //!< currently position
+  Ptr<UniformRandomVariable> m_rv; //!< rv for the random part of the position
+  uint64_t m_seed; //!< seed of the GetAt streams
   uint32_t m_num;
   double m_bound; //!< minimum boundary on x positions
   uint32_t m_grid;  //!< number of positions to allocate on each row or column
@@ -410,9 +534,31 @@ public:
   uint32_t GetN (void) const;
 
   virtual Vector GetNext (void) const;
+  /**
+   * Draws the random numbers of a chunk of positions first, then computes
+   * the positions from tables of the road and lane centre-lines.
+   */
+  virtual void GetNextBatch (Vector *positions, uint32_t n) const;
+  /**
+   * Position i is laid out like the i-th position of GetNext, with its
+   * road, lane and position along the road drawn from a PhiloxStream
+   * keyed by Seed and i. The layout is the same whatever the order of
+   * the calls, but it is not the one of GetNext, which draws from the
+   * ns-3 random streams.
+   *
+   * Calls may come from several threads once the road layout exists:
+   * set RoadGrid, or make a first call from a single thread.
+   */
+  virtual Vector GetAt (uint32_t i) const;
   virtual int64_t AssignStreams (int64_t stream);
 private:
+  /** Build the road layout from our own attributes if none was set. */
+  void CheckRoadGrid (void) const;
+
   mutable uint32_t m_current; //!< currently position
+  mutable Ptr<RoadGrid> m_roadGrid; //!< road layout
+  Ptr<UniformRandomVariable> m_rv; //!< rv for picking the road, lane and position
+  uint64_t m_seed; //!< seed of the GetAt streams
   uint32_t m_num;
   double m_bound;
   uint32_t m_intersection;
@@ -0,0 +1,210 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Convert a CSV file of positions to a position list file, to be mapped
+// by FileListPositionAllocator instead of filling a ListPositionAllocator
+// one Add at a time.
+//
+// ./waf --run "position-list-tool --input=start.csv --output=start.pos"
+//
+// Fields are separated by commas, semicolons, tabs or spaces. Empty lines,
+// lines starting with # and lines whose x or y is not a number (such as a
+// header line) are skipped. The input is read and the output written in
+// fixed size chunks, so any number of positions converts in the same
+// memory.
+//
+// ./waf --run "position-list-tool --input=gps.csv --xColumn=2 --yColumn=3 --output=start.pos"
+
+#include "position-allocator.h"
+#include "ns3/command-line.h"
+#include "ns3/abort.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \param c a character
+ * \return true if c separates two fields
+ */
+static bool
+IsSeparator (char c)
+{
+  return c == ',' || c == ';' || c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * \param line the start of a line, ending with a newline or a NUL
+ * \param columns the columns of x, y and z, -1 for a z of 0
+ * \param v set to the position of the line
+ * \return false if the line holds no position
+ */
+static bool
+ParseLine (const char *line, const int32_t columns[3], Vector &v)
+{
+  double value[3] = { 0, 0, 0 };
+  bool found[3] = { false, false, columns[2] < 0 };
+  int32_t last = std::max (columns[0], std::max (columns[1], columns[2]));
+  const char *p = line;
+  for (int32_t column = 0; column <= last; column++)
+    {
+      while (*p == ' ' || *p == '\t')
+        {
+          p++;
+        }
+      if (*p == '#' && column == 0)
+        {
+          return false;
+        }
+      for (uint32_t k = 0; k < 3; k++)
+        {
+          // strtod would skip an empty field and the newline after it
+          if (columns[k] == column && *p != '\0' && *p != '\n' && !IsSeparator (*p))
+            {
+              char *end;
+              value[k] = std::strtod (p, &end);
+              found[k] = end != p;
+            }
+        }
+      // on to the next field
+      while (*p != '\0' && *p != '\n' && !IsSeparator (*p))
+        {
+          p++;
+        }
+      if (*p == '\0' || *p == '\n')
+        {
+          break;
+        }
+      // consecutive spaces are a single separator, unlike commas
+      bool blank = *p == ' ' || *p == '\t';
+      p++;
+      while (blank && (*p == ' ' || *p == '\t'))
+        {
+          p++;
+        }
+    }
+  if (!found[0] || !found[1] || !found[2])
+    {
+      return false;
+    }
+  v = Vector (value[0], value[1], value[2]);
+  return true;
+}
+
+int main (int argc, char *argv[])
+{
+  std::string input = "positions.csv";
+  std::string output = "positions.pos";
+  int32_t xColumn = 0;
+  int32_t yColumn = 1;
+  int32_t zColumn = -1;
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "CSV file to convert", input);
+  cmd.AddValue ("output", "position list file to write", output);
+  cmd.AddValue ("xColumn", "column of x, from 0", xColumn);
+  cmd.AddValue ("yColumn", "column of y, from 0", yColumn);
+  cmd.AddValue ("zColumn", "column of z, from 0, or -1 for a z of 0", zColumn);
+  cmd.Parse (argc, argv);
+  NS_ABORT_MSG_IF (xColumn < 0 || yColumn < 0, "position-list-tool: bad xColumn or yColumn");
+  int32_t columns[3] = { xColumn, yColumn, zColumn };
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  FILE *in = std::fopen (input.c_str (), "rb");
+  NS_ABORT_MSG_IF (in == 0, "position-list-tool: cannot open " << input);
+  FILE *out = std::fopen (output.c_str (), "wb");
+  NS_ABORT_MSG_IF (out == 0, "position-list-tool: cannot open " << output);
+
+  // the count is only known at the end: written again then
+  PositionListHeader header;
+  std::memcpy (header.magic, "MKVPOS01", sizeof (header.magic));
+  header.positions = 0;
+  NS_ABORT_MSG_IF (std::fwrite (&header, sizeof (header), 1, out) != 1,
+                   "position-list-tool: cannot write " << output);
+
+  const size_t chunk = 1 << 20;
+  std::vector<char> buffer (chunk + 1);
+  std::vector<Vector> positions;
+  positions.reserve (chunk / 16);
+  uint64_t lines = 0;
+  size_t kept = 0; // bytes of an unfinished line at the start of the buffer
+  while (true)
+    {
+      size_t read = std::fread (&buffer[kept], 1, buffer.size () - 1 - kept, in);
+      size_t size = kept + read;
+      bool last = read == 0;
+      if (size == 0)
+        {
+          break;
+        }
+      buffer[size] = '\0';
+      // only whole lines, unless there is nothing left to read
+      size_t end = size;
+      if (!last)
+        {
+          while (end > 0 && buffer[end - 1] != '\n')
+            {
+              end--;
+            }
+          if (end == 0)
+            {
+              // a line longer than the buffer
+              buffer.resize (2 * buffer.size ());
+              kept = size;
+              continue;
+            }
+        }
+      for (size_t p = 0; p < end; )
+        {
+          Vector v;
+          if (ParseLine (&buffer[p], columns, v))
+            {
+              positions.push_back (v);
+            }
+          lines++;
+          const char *eol = (const char *) std::memchr (&buffer[p], '\n', end - p);
+          p = eol != 0 ? eol - &buffer[0] + 1 : end;
+        }
+      if (!positions.empty ())
+        {
+          NS_ABORT_MSG_IF (std::fwrite (&positions[0], sizeof (Vector), positions.size (), out) != positions.size (),
+                           "position-list-tool: cannot write " << output);
+          header.positions += positions.size ();
+          positions.clear ();
+        }
+      kept = size - end;
+      std::memmove (&buffer[0], &buffer[end], kept);
+      if (last)
+        {
+          break;
+        }
+    }
+  std::fclose (in);
+
+  std::rewind (out);
+  NS_ABORT_MSG_IF (std::fwrite (&header, sizeof (header), 1, out) != 1 || std::fclose (out) != 0,
+                   "position-list-tool: cannot write " << output);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  std::cout << header.positions << " positions of " << lines << " lines written to "
+            << output << " in " << elapsed.count () << " s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,406 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "road-grid.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/log.h"
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("RoadGrid");
+
+NS_OBJECT_ENSURE_REGISTERED (RoadGrid);
+
+// southbound and eastbound vehicles drive above the centre-line
+static const bool g_high[4] = { false, true, false, true };
+// heading after going straight, turning right and turning left
+static const uint8_t g_turned[4][3] = { { 0, 2, 3 }, { 1, 3, 2 }, { 2, 1, 0 }, { 3, 0, 1 } };
+// heading after a rebound
+static const uint8_t g_reversed[4] = { 1, 0, 3, 2 };
+
+TypeId
+RoadGrid::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::RoadGrid")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<RoadGrid> ()
+    .AddAttribute ("Grid", "number of lines",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&RoadGrid::SetGrid,
+                                         &RoadGrid::GetGrid),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Intersection", "number of intersections",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&RoadGrid::SetIntersection,
+                                         &RoadGrid::GetIntersection),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Distance", "Distance between intersections",
+                   DoubleValue (500.0),
+                   MakeDoubleAccessor (&RoadGrid::SetDistance,
+                                       &RoadGrid::GetDistance),
+                   MakeDoubleChecker<double> (0.0))
+  ;
+  return tid;
+}
+
+RoadGrid::RoadGrid ()
+  : m_grid (2),
+    m_intersection (1),
+    m_distance (500.0)
+{
+  Update ();
+}
+
+void
+RoadGrid::SetGrid (uint32_t grid)
+{
+  m_grid = grid;
+  Update ();
+}
+void
+RoadGrid::SetIntersection (uint32_t intersection)
+{
+  m_intersection = intersection;
+  Update ();
+}
+void
+RoadGrid::SetDistance (double distance)
+{
+  m_distance = distance;
+  Update ();
+}
+
+uint32_t
+RoadGrid::GetGrid (void) const
+{
+  return m_grid;
+}
+uint32_t
+RoadGrid::GetIntersection (void) const
+{
+  return m_intersection;
+}
+double
+RoadGrid::GetDistance (void) const
+{
+  return m_distance;
+}
+
+Rectangle
+RoadGrid::GetBounds (void) const
+{
+  return Rectangle (0, m_distance * m_intersection, 0, m_distance * m_intersection);
+}
+const RoadGrid::Lines &
+RoadGrid::GetLines (void) const
+{
+  return m_lines;
+}
+double
+RoadGrid::GetRoadCentre (uint32_t i) const
+{
+  NS_ASSERT (i < m_roads.size ());
+  return m_roads[i];
+}
+double
+RoadGrid::GetLaneCentre (uint32_t lane) const
+{
+  NS_ASSERT (lane < m_lanes.size ());
+  return m_lanes[lane];
+}
+double
+RoadGrid::GetLaneOffset (bool high, uint32_t lane) const
+{
+  NS_ASSERT (lane < m_grid);
+  return m_laneOffsets[high * m_grid + lane];
+}
+uint32_t
+RoadGrid::GetLane (double offset) const
+{
+  // lanes are 3 m wide, the innermost one 1.5 m off the centre-line
+  double lane = std::floor (std::abs (offset - m_lines.centre) / 3);
+  return lane < m_grid ? (uint32_t) lane : m_grid - 1;
+}
+Vector
+RoadGrid::GetIntersectionPosition (uint32_t i, uint32_t j) const
+{
+  return Vector (GetRoadCentre (i), GetRoadCentre (j), 0.0);
+}
+double
+RoadGrid::GetTurnPoint (bool positive, uint32_t turn) const
+{
+  NS_ASSERT (turn < 3);
+  return m_turnPoint[positive][turn];
+}
+double
+RoadGrid::GetTurnLane (bool high, uint32_t turn) const
+{
+  NS_ASSERT (turn < 3);
+  return m_turnLane[high][turn];
+}
+
+Vector
+RoadGrid::GetPosition (const Place &place, double offset) const
+{
+  double a = place.block * m_distance + offset;
+  double c = place.road * m_distance + GetLaneOffset (g_high[place.heading], place.lane);
+  return place.heading < 2 ? Vector (c, a, 0) : Vector (a, c, 0);
+}
+
+void
+RoadGrid::Locate (Place &place, const Vector &position) const
+{
+  double across;
+  bool vertical = place.heading < 2;
+  place.road = GetBlock (vertical ? position.x : position.y, across);
+  place.block = GetBlock (vertical ? position.y : position.x, place.offset);
+  place.lane = GetLane (across);
+}
+
+void
+RoadGrid::Start (Place &place, const Vector &position) const
+{
+  double ox, oy;
+  GetBlock (position.x, ox);
+  GetBlock (position.y, oy);
+  double Rx = ox - m_lines.origin;
+  double Ry = oy - m_lines.origin;
+  // the lanes are 3 m apart; the lanes of the first heading of each road
+  // lie below its centre-line
+  double Kx = std::floor (Rx / 3 + 0.5);
+  if (Kx > 0 && std::abs (Rx / 3 - Kx) < 1e-9)
+    {
+      place.heading = Rx < m_lines.width + 1.5 ? 0 : 1;
+    }
+  else
+    {
+      place.heading = Ry < m_lines.width + 1.5 ? 2 : 3;
+    }
+  Locate (place, position);
+
+  place.approach = m_grid == 1
+    && ((ox < m_lines.edgeLow && oy > m_lines.centre)
+        || (ox > m_lines.edgeHigh && oy < m_lines.centre)
+        || (ox < m_lines.centre && oy < m_lines.edgeLow)
+        || (ox > m_lines.centre && oy > m_lines.edgeHigh));
+}
+
+RoadGrid::Step
+RoadGrid::GetStep (const Place &place, double offset, double next, const Rectangle &bounds) const
+{
+  if (!bounds.IsInside (GetPosition (place, next)))
+    {
+      return REBOUND;
+    }
+  double to;
+  int64_t block = GetBlock (next, to);
+  if (place.approach)
+    {
+      // the step reaches the turn point of the next turn
+      bool positive = GetSign (place.heading) > 0;
+      double p = GetTurnPoint (positive, place.turn);
+      return (positive ? p <= to : p >= to) ? TURN : WALK;
+    }
+  // the step crosses a block edge
+  return GetBlock (offset, offset) != block ? LANE : WALK;
+}
+
+uint64_t
+RoadGrid::GetWalkSteps (const Place &place, double length, const Rectangle &bounds) const
+{
+  double next = place.offset + length;
+  if (length == 0 || GetStep (place, place.offset, next, bounds) != WALK)
+    {
+      return 1;
+    }
+
+  // vehicles only ever move along their road: every distance below is a
+  // subtraction, and the steps to cover it a division
+  double a = place.block * m_distance + place.offset;
+  bool positive = length > 0;
+  double step = std::abs (length);
+  double dist;
+  if (place.heading < 2)
+    {
+      dist = positive ? bounds.yMax - a : a - bounds.yMin;
+    }
+  else
+    {
+      dist = positive ? bounds.xMax - a : a - bounds.xMin;
+    }
+  // a step ending past the bounds rebounds
+  double k = std::floor (dist / step);
+
+  double offset;
+  GetBlock (place.offset, offset);
+  if (place.approach)
+    {
+      double p = GetTurnPoint (positive, place.turn);
+      dist = positive ? p - offset : offset - p;
+      if (dist <= 0)
+        {
+          // already past it in this block
+          dist += m_distance;
+        }
+      // a step ending on the turn point turns
+      k = std::min (k, std::ceil (dist / step) - 1);
+    }
+  else if (positive)
+    {
+      // a step ending on the next block edge crosses it
+      k = std::min (k, std::ceil ((m_distance - offset) / step) - 1);
+    }
+  else
+    {
+      // a step ending on the block edge behind does not cross it
+      k = std::min (k, std::floor (offset / step));
+    }
+  return (uint64_t) k + 1;
+}
+
+void
+RoadGrid::Turn (Place &place, double offset, double next) const
+{
+  int64_t block = place.block + GetBlock (offset, offset);
+  if (place.turn != 0)
+    {
+      bool positive = GetSign (place.heading) > 0;
+      double p = GetTurnPoint (positive, place.turn);
+      GetBlock (next, next);
+      // what was driven past the turn point goes along the crossing road,
+      // which runs through the middle of this block
+      double over = positive ? next - p : p - next;
+      uint8_t turned = g_turned[place.heading][place.turn];
+      offset = GetLaneOffset (g_high[place.heading], place.lane) + GetSign (turned) * over;
+      int64_t road = place.road;
+      place.road = block;
+      block = road + GetBlock (offset, offset);
+      // a right turn ends on the outermost lane, a left turn on the innermost one
+      place.lane = place.turn == 1 ? m_grid - 1 : 0;
+      place.heading = turned;
+    }
+  place.block = block;
+  place.offset = offset;
+  place.approach = false;
+}
+
+bool
+RoadGrid::ChangeLane (Place &place, double offset) const
+{
+  place.block += GetBlock (offset, place.offset);
+  place.approach = true;
+  uint32_t lane = place.lane;
+  // right turns go to the outermost lane, left turns to the innermost one
+  if (place.turn == 1)
+    {
+      place.lane = m_grid - 1;
+    }
+  else if (place.turn == 2)
+    {
+      place.lane = 0;
+    }
+  return place.lane != lane;
+}
+
+void
+RoadGrid::Rebound (Place &place, double next, const Rectangle &bounds) const
+{
+  double a = place.block * m_distance + next;
+  switch (place.heading)
+    {
+    case 0:
+      a = std::min (a, bounds.yMax) - 1;
+      break;
+    case 1:
+      a = std::max (a, bounds.yMin) + 1;
+      break;
+    case 2:
+      a = std::max (a, bounds.xMin) + 1;
+      break;
+    case 3:
+      a = std::min (a, bounds.xMax) - 1;
+      break;
+    }
+  if (place.turn == 1)
+    {
+      place.lane = m_grid - 1;
+    }
+  else if (place.turn == 2)
+    {
+      place.lane = 0;
+    }
+  else
+    {
+      place.lane = m_grid - 1 - place.lane;
+    }
+  place.heading = g_reversed[place.heading];
+  place.block = GetBlock (a, place.offset);
+  place.approach = true;
+}
+
+void
+RoadGrid::Update (void)
+{
+  NS_LOG_FUNCTION (this << m_grid << m_intersection << m_distance);
+  m_inverse = 1 / m_distance;
+  m_lines.centre = m_distance/2;
+  m_lines.outerLow = m_distance/2-(3*m_grid-1.5);
+  m_lines.outerHigh = m_distance/2+(3*m_grid-1.5);
+  m_lines.innerLow = m_distance/2-1.5;
+  m_lines.innerHigh = m_distance/2+1.5;
+  m_lines.edgeLow = m_distance/2 - 3 * m_grid;
+  m_lines.edgeHigh = m_distance/2 + 3 * m_grid;
+  m_lines.origin = m_distance / 2 - (3 * m_grid + 1.5);
+  m_lines.width = 3 * m_grid;
+
+  m_roads.resize (m_intersection);
+  for (uint32_t i = 0; i < m_intersection; i++)
+    {
+      m_roads[i] = m_distance * (i + 0.5);
+    }
+  m_lanes.resize (m_grid);
+  for (uint32_t j = 0; j < m_grid; j++)
+    {
+      m_lanes[j] = 3 * j + 1.5;
+    }
+  // by side of the road; the outermost and innermost lanes fall on the outer and inner lines
+  m_laneOffsets.resize (2 * m_grid);
+  for (uint32_t j = 0; j < m_grid; j++)
+    {
+      m_laneOffsets[j] = m_lines.centre - m_lanes[j];
+      m_laneOffsets[m_grid + j] = m_lines.centre + m_lanes[j];
+    }
+
+  // a right turn ends on the outermost lane and a left turn on the innermost
+  // lane of the crossing road, on the side the vehicle is heading to
+  m_turnPoint[0][0] = m_lines.centre;
+  m_turnPoint[0][1] = m_lines.outerHigh;
+  m_turnPoint[0][2] = m_lines.innerLow;
+  m_turnPoint[1][0] = m_lines.centre;
+  m_turnPoint[1][1] = m_lines.outerLow;
+  m_turnPoint[1][2] = m_lines.innerHigh;
+
+  m_turnLane[0][0] = m_lines.centre;
+  m_turnLane[0][1] = m_lines.outerLow;
+  m_turnLane[0][2] = m_lines.innerLow;
+  m_turnLane[1][0] = m_lines.centre;
+  m_turnLane[1][1] = m_lines.outerHigh;
+  m_turnLane[1][2] = m_lines.innerHigh;
+}
+
+} // namespace ns3
@@ -0,0 +1,309 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef ROAD_GRID_H
+#define ROAD_GRID_H
+
+#include "ns3/object.h"
+#include "ns3/rectangle.h"
+#include "ns3/vector.h"
+#include <vector>
+#include <cmath>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Road layout shared by IntersectionsPosition and Intersections.
+ *
+ * The map is a lattice of Intersection x Intersection blocks of
+ * Distance x Distance meters. A road runs through the middle of each
+ * block in both directions and carries Grid lanes of 3 m each way.
+ * Everything the allocator and the mobility model derive from these
+ * three numbers is computed once here, so a single instance can be
+ * handed to every vehicle of a scenario.
+ *
+ * The walk of the Markov intersection model is also implemented here,
+ * on a Place in road coordinates, so Intersections, IntersectionsFleet
+ * and IntersectionsBatch turn, change lanes and rebound the same way.
+ * The engines only decide when a step happens and draw the random
+ * numbers; the headings are numbered 0 +y, 1 -y, 2 -x, 3 +x and the
+ * turns 0 straight, 1 right, 2 left.
+ */
+class RoadGrid : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  RoadGrid ();
+
+  /**
+   * Offsets inside a block of the lines the turn logic works with.
+   * "Low" lines lie below the road centre-line, "high" lines above it.
+   */
+  struct Lines
+  {
+    double centre;    //!< road centre-line, Distance/2
+    double outerLow;  //!< outermost lane, Distance/2-(3*Grid-1.5)
+    double outerHigh; //!< outermost lane, Distance/2+(3*Grid-1.5)
+    double innerLow;  //!< innermost lane, Distance/2-1.5
+    double innerHigh; //!< innermost lane, Distance/2+1.5
+    double edgeLow;   //!< road edge, Distance/2-3*Grid
+    double edgeHigh;  //!< road edge, Distance/2+3*Grid
+    double origin;    //!< one lane beyond the low edge, Distance/2-(3*Grid+1.5)
+    double width;     //!< width of the lanes of one direction, 3*Grid
+  };
+
+  /**
+   * Where a vehicle is on the roads: lane of road, and offset along it.
+   * A vehicle always drives on the centre-line of its lane.
+   */
+  struct Place
+  {
+    double offset;          //!< offset along the road from the start of block `block`
+    int32_t road;           //!< road the vehicle drives on, numbered like the blocks across its heading
+    int32_t block;          //!< block along the heading the offset is counted from
+    uint32_t lane : 16;     //!< lane, 0 being next to the centre-line
+    uint32_t heading : 2;   //!< heading: 0 +y, 1 -y, 2 -x, 3 +x
+    uint32_t turn : 2;      //!< turn at the next intersection: 0 straight, 1 right, 2 left
+    uint32_t approach : 1;  //!< heading for an intersection, not for the next block
+  };
+
+  /** What a walk step ends with. */
+  enum Step
+  {
+    WALK,     //!< move on
+    TURN,     //!< turn at the intersection, see Turn
+    LANE,     //!< enter the next block on the lane of the next turn, see ChangeLane
+    REBOUND   //!< turn back at the bounds, see Rebound
+  };
+
+  void SetGrid (uint32_t grid);
+  void SetIntersection (uint32_t intersection);
+  void SetDistance (double distance);
+
+  uint32_t GetGrid (void) const;
+  uint32_t GetIntersection (void) const;
+  double GetDistance (void) const;
+
+  /**
+   * \brief Split a coordinate into a block index and an offset inside the block
+   *
+   * This is the closed form of the offset loop Intersections::CalPercent
+   * used to run; it also works for negative coordinates.
+   *
+   * \param a the coordinate, on either axis
+   * \param offset set to the offset of a inside its block, in [0, Distance)
+   * \return the index of the block holding a, negative below 0
+   */
+  int64_t GetBlock (double a, double &offset) const;
+  /**
+   * \return the area covered by the lattice, (0, Distance*Intersection) on both axes
+   */
+  Rectangle GetBounds (void) const;
+  /**
+   * \return the precomputed lines of a block
+   */
+  const Lines &GetLines (void) const;
+  /**
+   * \param i the index of a road, in [0, Intersection)
+   * \return the coordinate of its centre-line
+   */
+  double GetRoadCentre (uint32_t i) const;
+  /**
+   * \param lane the index of a lane, 0 being next to the centre-line
+   * \return the distance between the lane centre-line and the road centre-line
+   */
+  double GetLaneCentre (uint32_t lane) const;
+  /**
+   * \param high true for the lanes above the road centre-line
+   * \param lane the index of a lane, 0 being next to the centre-line
+   * \return the offset inside a block of the lane centre-line
+   */
+  double GetLaneOffset (bool high, uint32_t lane) const;
+  /**
+   * \param offset an offset inside a block, across a road
+   * \return the index of the lane it lies on, counted from the centre-line
+   *         on either side of it, the outermost lane beyond the road edge
+   */
+  uint32_t GetLane (double offset) const;
+  /**
+   * \param i the column of the intersection
+   * \param j the row of the intersection
+   * \return the centre of the intersection
+   */
+  Vector GetIntersectionPosition (uint32_t i, uint32_t j) const;
+  /**
+   * \param positive true if the vehicle moves towards increasing coordinates
+   * \param turn 0 to go straight, 1 to turn right, 2 to turn left
+   * \return the offset inside a block at which the vehicle turns
+   */
+  double GetTurnPoint (bool positive, uint32_t turn) const;
+  /**
+   * \param high true for the lanes above the road centre-line
+   * \param turn 1 to turn right, 2 to turn left
+   * \return the offset inside a block of the lane the turn is taken from
+   */
+  double GetTurnLane (bool high, uint32_t turn) const;
+
+  /**
+   * \param heading a heading
+   * \return 1 if it runs towards increasing coordinates, -1 otherwise
+   */
+  static double GetSign (uint32_t heading);
+  /**
+   * \param place where a vehicle is
+   * \param offset an offset along its road, from the start of place.block
+   * \return the position at that offset on the lane of the vehicle
+   */
+  Vector GetPosition (const Place &place, double offset) const;
+  /**
+   * \brief Put a vehicle on its road at a position
+   *
+   * The heading is kept; the vehicle goes on the lane of that heading
+   * nearest to the position.
+   *
+   * \param place set to where the vehicle is; its heading is used
+   * \param position the position of the vehicle
+   */
+  void Locate (Place &place, const Vector &position) const;
+  /**
+   * \brief Put a vehicle on the roads at its start position
+   *
+   * The heading is the one of the lane the position lies on, up to the
+   * rounding of the Distance multiples: a vertical lane if the position
+   * is a whole number of lanes off the road edge across x, else a
+   * horizontal one. The vehicle then goes on the nearest lane of that
+   * heading. With one lane each way, a vehicle starting in the corner of
+   * an intersection it is leaving is still heading for it. The turn is
+   * left to the caller.
+   *
+   * \param place set to where the vehicle starts
+   * \param position the start position
+   */
+  void Start (Place &place, const Vector &position) const;
+  /**
+   * \param place where a vehicle is
+   * \param offset the offset along its road at the start of a walk step,
+   *        from the start of place.block
+   * \param next the offset at its end
+   * \param bounds the bounds of the walk
+   * \return what the step ends with
+   */
+  Step GetStep (const Place &place, double offset, double next, const Rectangle &bounds) const;
+  /**
+   * \brief Count the walk steps until one ends with something else than WALK
+   *
+   * This is the closed form of calling GetStep on every step.
+   *
+   * \param place where a vehicle is, at the start of the first step
+   * \param length the length of one walk step along the road, negative
+   *        for the headings towards decreasing coordinates
+   * \param bounds the bounds of the walk
+   * \return the number of steps (at least 1) up to the first one that
+   *         does not end with WALK
+   */
+  uint64_t GetWalkSteps (const Place &place, double length, const Rectangle &bounds) const;
+  /**
+   * \brief Turn onto the crossing road at the end of a walk step
+   *
+   * The vehicle is left where the step started, on the crossing road if
+   * it turns, with what it drove past the turn point along that road.
+   * The turn it took is kept in place.turn.
+   *
+   * \param place where the vehicle is
+   * \param offset the offset along the road at the start of the step
+   * \param next the offset at its end
+   */
+  void Turn (Place &place, double offset, double next) const;
+  /**
+   * \brief Move to the lane of the next turn at the end of a walk step
+   *
+   * The vehicle is left where the step started, short of the block edge.
+   *
+   * \param place where the vehicle is
+   * \param offset the offset along the road at the start of the step
+   * \return true if the vehicle moved to another lane
+   */
+  bool ChangeLane (Place &place, double offset) const;
+  /**
+   * \brief Turn back at the bounds
+   *
+   * The vehicle comes back one meter inside the bounds, on the other side
+   * of the road, on the lane of its next turn or else on the lane facing
+   * its own.
+   *
+   * \param place where the vehicle is
+   * \param next the offset along the road where it reaches the bounds,
+   *        from the start of place.block
+   * \param bounds the bounds of the walk
+   */
+  void Rebound (Place &place, double next, const Rectangle &bounds) const;
+
+private:
+  /**
+   * Recompute the cached geometry after an attribute changed.
+   */
+  void Update (void);
+
+  uint32_t m_grid;          //!< number of lanes each way
+  uint32_t m_intersection;  //!< number of intersections on each axis
+  double m_distance;        //!< distance between intersections
+  double m_inverse;         //!< 1 / m_distance
+
+  Lines m_lines;                  //!< lines of a block
+  std::vector<double> m_roads;    //!< road centre-lines
+  std::vector<double> m_lanes;    //!< lane centre-lines around a road centre-line
+  std::vector<double> m_laneOffsets; //!< lane centre-lines inside a block, the low side first
+  double m_turnPoint[2][3];       //!< turn points by direction of travel and turn
+  double m_turnLane[2][3];        //!< turn lanes by side of the road and turn
+};
+
+inline int64_t
+RoadGrid::GetBlock (double a, double &offset) const
+{
+  double block = std::floor (a * m_inverse);
+  offset = a - block * m_distance;
+  // the product can round across a block edge
+  if (offset < 0)
+    {
+      offset += m_distance;
+      block -= 1;
+      // a tiny negative a rounds up to a whole block: keep it below 0
+      if (offset >= m_distance)
+        {
+          offset = std::nextafter (m_distance, 0.0);
+        }
+    }
+  else if (offset >= m_distance)
+    {
+      offset -= m_distance;
+      block += 1;
+    }
+  return (int64_t) block;
+}
+
+inline double
+RoadGrid::GetSign (uint32_t heading)
+{
+  return heading == 0 || heading == 3 ? 1 : -1;
+}
+
+} // namespace ns3
+
+#endif /* ROAD_GRID_H */
@@ -0,0 +1,156 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "trace-replay-mobility-model.h"
+#include "ns3/simulator.h"
+#include "ns3/pointer.h"
+#include "ns3/uinteger.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TraceReplayMobilityModel");
+
+NS_OBJECT_ENSURE_REGISTERED (TraceReplayMobilityModel);
+
+TypeId
+TraceReplayMobilityModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TraceReplayMobilityModel")
+    .SetParent<MobilityModel> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<TraceReplayMobilityModel> ()
+    .AddAttribute ("TraceFile", "The trajectory trace to replay.",
+                   PointerValue (),
+                   MakePointerAccessor (&TraceReplayMobilityModel::m_file),
+                   MakePointerChecker<TrajectoryTraceFile> ())
+    .AddAttribute ("Vehicle", "The index of the vehicle to replay; by default "
+                   "the first one of the trace not replayed by another model yet.",
+                   UintegerValue (0xffffffff),
+                   MakeUintegerAccessor (&TraceReplayMobilityModel::m_vehicle),
+                   MakeUintegerChecker<uint32_t> ())
+  ;
+  return tid;
+}
+
+TraceReplayMobilityModel::TraceReplayMobilityModel ()
+  : m_vehicle (0xffffffff),
+    m_hasNext (false)
+{
+}
+
+TraceReplayMobilityModel::~TraceReplayMobilityModel ()
+{
+}
+
+void
+TraceReplayMobilityModel::DoDispose (void)
+{
+  m_event.Cancel ();
+  m_file = 0;
+  MobilityModel::DoDispose ();
+}
+
+void
+TraceReplayMobilityModel::DoInitialize (void)
+{
+  NS_ABORT_MSG_IF (m_file == 0, "TraceReplayMobilityModel: no TraceFile set");
+  if (m_vehicle == 0xffffffff)
+    {
+      m_vehicle = m_file->AllocateVehicle ();
+    }
+  m_cursor = m_file->GetCursor (m_vehicle);
+  m_hasNext = m_cursor.Next (m_nextTime, m_nextPosition, m_nextVelocity);
+  if (m_hasNext)
+    {
+      // stand still at the first waypoint until it is due
+      m_time = Simulator::Now ();
+      m_position = m_nextPosition;
+      m_velocity = Vector (0, 0, 0);
+    }
+  Advance ();
+  MobilityModel::DoInitialize ();
+}
+
+void
+TraceReplayMobilityModel::Advance (void)
+{
+  Time now = Simulator::Now ();
+  // waypoints recorded at the same time are replayed together
+  while (m_hasNext && m_nextTime <= now)
+    {
+      m_time = m_nextTime;
+      m_position = m_nextPosition;
+      m_velocity = m_nextVelocity;
+      m_hasNext = m_cursor.Next (m_nextTime, m_nextPosition, m_nextVelocity);
+    }
+  if (m_hasNext)
+    {
+      m_event = Simulator::Schedule (m_nextTime - now, &TraceReplayMobilityModel::Advance, this);
+    }
+  NotifyCourseChange ();
+}
+
+uint32_t
+TraceReplayMobilityModel::GetVehicle (void) const
+{
+  return m_vehicle;
+}
+
+Vector
+TraceReplayMobilityModel::DoGetPosition (void) const
+{
+  double t = (Simulator::Now () - m_time).GetSeconds ();
+  return Vector (m_position.x + m_velocity.x * t,
+                 m_position.y + m_velocity.y * t,
+                 m_position.z + m_velocity.z * t);
+}
+
+void
+TraceReplayMobilityModel::DoSetPosition (const Vector &position)
+{
+  m_time = Simulator::Now ();
+  m_position = position;
+  NotifyCourseChange ();
+}
+
+Vector
+TraceReplayMobilityModel::DoGetVelocity (void) const
+{
+  return m_velocity;
+}
+
+uint8_t
+TraceReplayMobilityModel::DoGetDirection (void) const
+{
+  // numbered like RoadGrid::Place::heading: 0 +y, 1 -y, 2 -x, 3 +x
+  if (m_velocity.y > 0)
+    {
+      return 0;
+    }
+  if (m_velocity.y < 0)
+    {
+      return 1;
+    }
+  return m_velocity.x < 0 ? 2 : 3;
+}
+
+void
+TraceReplayMobilityModel::DoSetDirection (const uint8_t)
+{
+}
+
+} // namespace ns3
@@ -0,0 +1,86 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TRACE_REPLAY_MOBILITY_MODEL_H
+#define TRACE_REPLAY_MOBILITY_MODEL_H
+
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "mobility-model.h"
+#include "trajectory-trace.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Replays the trajectory of one vehicle of a trajectory trace.
+ *
+ * The model only holds a cursor into the memory-mapped TrajectoryTraceFile
+ * and the segment it is on: the position is interpolated from the last
+ * waypoint when asked for, and the next waypoint is decoded by the event
+ * scheduled at its time, so there is one event and one CourseChange per
+ * waypoint and the memory used does not depend on the length of the trace.
+ *
+ * Until the first waypoint the vehicle stands still at its position; after
+ * the last one it keeps the velocity of the last one. A position set before
+ * the model is initialized is overwritten by the trace; one set afterwards
+ * holds until the next waypoint.
+ */
+class TraceReplayMobilityModel : public MobilityModel
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  TraceReplayMobilityModel ();
+  virtual ~TraceReplayMobilityModel ();
+
+  /**
+   * \return the index of the replayed vehicle in the trace
+   */
+  uint32_t GetVehicle (void) const;
+
+private:
+  virtual void DoDispose (void);
+  virtual void DoInitialize (void);
+  virtual Vector DoGetPosition (void) const;
+  virtual void DoSetPosition (const Vector &position);
+  virtual Vector DoGetVelocity (void) const;
+  virtual uint8_t DoGetDirection (void) const;
+  virtual void DoSetDirection (const uint8_t direction);
+
+  /**
+   * Move on to every waypoint that is due, and schedule the next one.
+   */
+  void Advance (void);
+
+  Ptr<TrajectoryTraceFile> m_file; //!< the trace
+  uint32_t m_vehicle; //!< index of the vehicle in the trace, or the next free one if unset
+  TrajectoryTraceCursor m_cursor; //!< the waypoints not read yet
+  Time m_time; //!< time of the start of the current segment
+  Vector m_position; //!< position at m_time
+  Vector m_velocity; //!< velocity on the current segment
+  bool m_hasNext; //!< false after the last waypoint
+  Time m_nextTime; //!< time of the next waypoint
+  Vector m_nextPosition; //!< position of the next waypoint
+  Vector m_nextVelocity; //!< velocity of the next waypoint
+  EventId m_event; //!< event of the next waypoint
+};
+
+} // namespace ns3
+
+#endif /* TRACE_REPLAY_MOBILITY_MODEL_H */
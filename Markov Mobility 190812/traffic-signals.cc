@@ -0,0 +1,211 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "traffic-signals.h"
+#include "ns3/pointer.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TrafficSignals");
+
+NS_OBJECT_ENSURE_REGISTERED (TrafficSignals);
+
+// headings of the north-south and of the east-west roads: 0 +y, 1 -y, 2 -x, 3 +x
+static const uint8_t g_northSouth = (1 << 0) | (1 << 1);
+static const uint8_t g_eastWest = (1 << 2) | (1 << 3);
+
+TypeId
+TrafficSignals::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TrafficSignals")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<TrafficSignals> ()
+    .AddAttribute ("GreenTime", "Green time of each road in the default plan.",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&TrafficSignals::m_greenTime),
+                   MakeTimeChecker ())
+    .AddAttribute ("ClearanceTime", "All-red time after each green of the default plan.",
+                   TimeValue (Seconds (3)),
+                   MakeTimeAccessor (&TrafficSignals::m_clearanceTime),
+                   MakeTimeChecker ())
+    .AddAttribute ("Offset",
+                   "Delay of the default cycle of an intersection after that of "
+                   "its neighbours on the left and below.",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&TrafficSignals::m_offset),
+                   MakeTimeChecker ())
+    .AddAttribute ("RoadGrid", "The road layout whose intersections have the signals.",
+                   PointerValue (),
+                   MakePointerAccessor (&TrafficSignals::SetRoadGrid,
+                                        &TrafficSignals::GetRoadGrid),
+                   MakePointerChecker<RoadGrid> ())
+    .AddTraceSource ("PhaseChange",
+                     "An intersection moved to its next phase.",
+                     MakeTraceSourceAccessor (&TrafficSignals::m_phaseChangeTrace),
+                     "ns3::TrafficSignals::PhaseChangeCallback")
+  ;
+  return tid;
+}
+
+TrafficSignals::TrafficSignals ()
+  : m_n (0)
+{
+}
+
+TrafficSignals::~TrafficSignals ()
+{
+}
+
+void
+TrafficSignals::DoDispose (void)
+{
+  for (uint32_t k = 0; k < m_events.size (); k++)
+    {
+      m_events[k].Cancel ();
+    }
+  m_roadGrid = 0;
+  Object::DoDispose ();
+}
+
+void
+TrafficSignals::SetRoadGrid (Ptr<RoadGrid> roadGrid)
+{
+  for (uint32_t k = 0; k < m_events.size (); k++)
+    {
+      m_events[k].Cancel ();
+    }
+  m_roadGrid = roadGrid;
+  m_n = m_roadGrid != 0 ? m_roadGrid->GetIntersection () : 0;
+  m_plans.assign (m_n * m_n, Plan ());
+  m_offsets.assign (m_n * m_n, Seconds (0));
+  m_phase.assign (m_n * m_n, 0);
+  m_green.assign (m_n * m_n, 0);
+  m_events.assign (m_n * m_n, EventId ());
+  if (IsInitialized ())
+    {
+      DoInitialize ();
+    }
+}
+
+Ptr<RoadGrid>
+TrafficSignals::GetRoadGrid (void) const
+{
+  return m_roadGrid;
+}
+
+void
+TrafficSignals::SetPlan (uint32_t i, uint32_t j, const Plan &plan, Time offset)
+{
+  NS_LOG_FUNCTION (this << i << j << plan.size () << offset);
+  NS_ABORT_MSG_IF (i >= m_n || j >= m_n, "TrafficSignals: no intersection (" << i << ", " << j << ")");
+  NS_ABORT_MSG_IF (plan.empty (), "TrafficSignals: a plan needs phases");
+  for (uint32_t p = 0; p < plan.size (); p++)
+    {
+      NS_ABORT_MSG_IF (!plan[p].duration.IsStrictlyPositive (),
+                       "TrafficSignals: phase " << p << " does not last");
+    }
+  uint32_t k = j * m_n + i;
+  m_plans[k] = plan;
+  m_offsets[k] = offset;
+  if (IsInitialized ())
+    {
+      m_events[k].Cancel ();
+      Start (k);
+    }
+}
+
+uint32_t
+TrafficSignals::GetPhase (uint32_t i, uint32_t j) const
+{
+  NS_ASSERT (i < m_n && j < m_n);
+  return m_phase[j * m_n + i];
+}
+
+void
+TrafficSignals::DoInitialize (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ABORT_MSG_IF (m_roadGrid == 0, "TrafficSignals: no RoadGrid set");
+  NS_ABORT_MSG_IF (!m_greenTime.IsStrictlyPositive () || m_clearanceTime.IsStrictlyNegative (),
+                   "TrafficSignals: bad GreenTime or ClearanceTime");
+  m_default.clear ();
+  for (uint32_t road = 0; road < 2; road++)
+    {
+      Phase green = { m_greenTime, road == 0 ? g_northSouth : g_eastWest };
+      m_default.push_back (green);
+      if (m_clearanceTime.IsStrictlyPositive ())
+        {
+          Phase red = { m_clearanceTime, 0 };
+          m_default.push_back (red);
+        }
+    }
+
+  for (uint32_t j = 0; j < m_n; j++)
+    {
+      for (uint32_t i = 0; i < m_n; i++)
+        {
+          uint32_t k = j * m_n + i;
+          if (m_plans[k].empty ())
+            {
+              m_offsets[k] = TimeStep (m_offset.GetTimeStep () * (i + j));
+            }
+          Start (k);
+        }
+    }
+  Object::DoInitialize ();
+}
+
+void
+TrafficSignals::Start (uint32_t k)
+{
+  const Plan &plan = m_plans[k].empty () ? m_default : m_plans[k];
+  int64_t cycle = 0;
+  for (uint32_t p = 0; p < plan.size (); p++)
+    {
+      cycle += plan[p].duration.GetTimeStep ();
+    }
+  int64_t t = (Simulator::Now () - m_offsets[k]).GetTimeStep () % cycle;
+  if (t < 0)
+    {
+      t += cycle;
+    }
+  uint32_t p = 0;
+  while (t >= plan[p].duration.GetTimeStep ())
+    {
+      t -= plan[p].duration.GetTimeStep ();
+      p++;
+    }
+  m_phase[k] = p;
+  m_green[k] = plan[p].green;
+  m_events[k] = Simulator::Schedule (plan[p].duration - TimeStep (t), &TrafficSignals::Change, this, k);
+}
+
+void
+TrafficSignals::Change (uint32_t k)
+{
+  const Plan &plan = m_plans[k].empty () ? m_default : m_plans[k];
+  uint32_t p = m_phase[k] + 1 < plan.size () ? m_phase[k] + 1 : 0;
+  m_phase[k] = p;
+  m_green[k] = plan[p].green;
+  m_events[k] = Simulator::Schedule (plan[p].duration, &TrafficSignals::Change, this, k);
+  m_phaseChangeTrace (k, plan[p].green);
+}
+
+} // namespace ns3
@@ -0,0 +1,152 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TRAFFIC_SIGNALS_H
+#define TRAFFIC_SIGNALS_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/traced-callback.h"
+#include "road-grid.h"
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Traffic lights at the intersections of a RoadGrid.
+ *
+ * Every intersection cycles through a plan of phases, each of which lets
+ * the vehicles of some headings (numbered like RoadGrid::Place::heading:
+ * 0 +y, 1 -y, 2 -x, 3 +x) enter the intersection. An intersection
+ * schedules one event per phase change, whatever the number of vehicles,
+ * and reports it through the PhaseChange trace source.
+ *
+ * Intersections without a plan of their own run the default plan:
+ * GreenTime of green for the north-south roads, ClearanceTime of red
+ * everywhere, GreenTime for the east-west roads and ClearanceTime of red
+ * again. The cycle of intersection (i, j) starts (i + j) * Offset after
+ * that of intersection (0, 0), for green waves along the diagonal.
+ *
+ * The plans start when the object is initialized; IntersectionsFleet does
+ * that when it is given the signals and its first vehicle.
+ */
+class TrafficSignals : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  TrafficSignals ();
+  virtual ~TrafficSignals ();
+
+  /** A phase of a plan. */
+  struct Phase
+  {
+    Time duration;  //!< how long the phase lasts
+    uint8_t green;  //!< bit h is set if vehicles of heading h may enter
+  };
+  /** The phases an intersection cycles through. */
+  typedef std::vector<Phase> Plan;
+
+  /**
+   * Size the signals to the intersections of a road layout; every plan
+   * is reset to the default one.
+   *
+   * \param roadGrid the road layout
+   */
+  void SetRoadGrid (Ptr<RoadGrid> roadGrid);
+  /**
+   * \return the road layout
+   */
+  Ptr<RoadGrid> GetRoadGrid (void) const;
+
+  /**
+   * \brief Give an intersection a plan of its own
+   *
+   * If the signals already run, the intersection switches to the phase
+   * the new plan is in at the current time.
+   *
+   * \param i the column of the intersection
+   * \param j the row of the intersection
+   * \param plan the phases, each lasting more than zero
+   * \param offset the time the first cycle starts at
+   */
+  void SetPlan (uint32_t i, uint32_t j, const Plan &plan, Time offset);
+  /**
+   * \param i the column of the intersection
+   * \param j the row of the intersection
+   * \return the index in its plan of the current phase
+   */
+  uint32_t GetPhase (uint32_t i, uint32_t j) const;
+  /**
+   * \param i the column of the intersection
+   * \param j the row of the intersection
+   * \param heading the heading of a vehicle about to enter it
+   * \return true if the vehicle may enter
+   */
+  bool IsGreen (uint32_t i, uint32_t j, uint8_t heading) const;
+
+  /**
+   * TracedCallback signature for phase changes.
+   *
+   * \param [in] intersection The index of the intersection, j * Intersection + i.
+   * \param [in] green The headings that may enter it from now on, one bit each.
+   */
+  typedef void (* PhaseChangeCallback)(uint32_t intersection, uint8_t green);
+
+private:
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+  /**
+   * Find the phase an intersection is in at the current time and
+   * schedule its next phase change.
+   * \param k the index of the intersection
+   */
+  void Start (uint32_t k);
+  /**
+   * Move an intersection to its next phase.
+   * \param k the index of the intersection
+   */
+  void Change (uint32_t k);
+
+  Ptr<RoadGrid> m_roadGrid; //!< road layout
+  Time m_greenTime; //!< green time of each road in the default plan
+  Time m_clearanceTime; //!< all-red time between the greens of the default plan
+  Time m_offset; //!< delay of the default cycle from one intersection to the next
+  uint32_t m_n; //!< intersections on each axis
+  Plan m_default; //!< the default plan, built at initialization
+  std::vector<Plan> m_plans; //!< plan of each intersection, empty for the default one
+  std::vector<Time> m_offsets; //!< start of the first cycle of each intersection
+  std::vector<uint32_t> m_phase; //!< current phase of each intersection
+  std::vector<uint8_t> m_green; //!< headings that may enter each intersection
+  std::vector<EventId> m_events; //!< next phase change of each intersection
+  TracedCallback<uint32_t, uint8_t> m_phaseChangeTrace; //!< phase change of an intersection
+};
+
+inline bool
+TrafficSignals::IsGreen (uint32_t i, uint32_t j, uint8_t heading) const
+{
+  NS_ASSERT (j * m_n + i < m_green.size ());
+  return (m_green[j * m_n + i] >> heading) & 1;
+}
+
+} // namespace ns3
+
+#endif /* TRAFFIC_SIGNALS_H */
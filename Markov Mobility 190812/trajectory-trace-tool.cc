@@ -0,0 +1,134 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Run the Markov intersection mobility without nodes or network stack
+// and write the waypoints of every vehicle as a trajectory trace, to be
+// replayed by TraceReplayMobilityModel in the network runs.
+//
+// ./waf --run "trajectory-trace-tool --vehicles=1000 --time=3600 --output=markov.trc"
+//
+// With --batch the vehicles are driven by IntersectionsBatch instead of
+// IntersectionsFleet, on --threads threads (all of them by default); the
+// trace is the same whatever the number of threads.
+//
+// ./waf --run "trajectory-trace-tool --vehicles=200000 --time=3600 --batch=1 --output=markov.trc"
+
+#include "intersections-fleet.h"
+#include "intersections-batch.h"
+#include "position-allocator.h"
+#include "road-grid.h"
+#include "trajectory-trace.h"
+#include "ns3/command-line.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/pointer.h"
+#include "ns3/string.h"
+#include "ns3/simulator.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+using namespace ns3;
+
+int main (int argc, char *argv[])
+{
+  uint32_t vehicles = 100;
+  double time = 600;
+  uint32_t grid = 2;
+  uint32_t intersection = 3;
+  double distance = 1000;
+  double speed = 16.667;
+  double deltaSpeed = 5.556;
+  int64_t stream = 0;
+  bool batch = false;
+  uint32_t threads = 0;
+  uint64_t seed = 1;
+  std::string output = "markov.trc";
+
+  CommandLine cmd;
+  cmd.AddValue ("vehicles", "number of vehicles", vehicles);
+  cmd.AddValue ("time", "simulated time in seconds", time);
+  cmd.AddValue ("grid", "number of lanes each way", grid);
+  cmd.AddValue ("intersection", "number of intersections on each axis", intersection);
+  cmd.AddValue ("distance", "distance between intersections", distance);
+  cmd.AddValue ("speed", "speed in m/s", speed);
+  cmd.AddValue ("deltaSpeed", "bound of the speed offset of each vehicle in m/s", deltaSpeed);
+  cmd.AddValue ("stream", "first random stream index", stream);
+  cmd.AddValue ("batch", "drive the vehicles with IntersectionsBatch", batch);
+  cmd.AddValue ("threads", "number of threads of the batch, 0 for all", threads);
+  cmd.AddValue ("seed", "seed of the random streams of the vehicles", seed);
+  cmd.AddValue ("output", "trace file to write", output);
+  cmd.Parse (argc, argv);
+
+  Ptr<RoadGrid> road = CreateObject<RoadGrid> ();
+  road->SetGrid (grid);
+  road->SetIntersection (intersection);
+  road->SetDistance (distance);
+
+  Ptr<IntersectionsPosition> position = CreateObject<IntersectionsPosition> ();
+  position->SetAttribute ("RoadGrid", PointerValue (road));
+  position->SetAttribute ("Num", UintegerValue (vehicles));
+  stream += position->AssignStreams (stream);
+
+  TrajectoryTraceWriter writer;
+  std::chrono::steady_clock::time_point start;
+  if (batch)
+    {
+      Ptr<IntersectionsBatch> generator = CreateObject<IntersectionsBatch> ();
+      generator->SetAttribute ("RoadGrid", PointerValue (road));
+      generator->SetAttribute ("MinSpeed", DoubleValue (speed));
+      generator->SetAttribute ("MaxSpeed", DoubleValue (speed));
+      generator->SetAttribute ("DeltaSpeed", DoubleValue (deltaSpeed));
+      generator->SetAttribute ("Seed", UintegerValue (seed));
+      generator->SetAttribute ("Threads", UintegerValue (threads));
+      for (uint32_t i = 0; i < vehicles; i++)
+        {
+          generator->Add (position->GetNext ());
+        }
+      start = std::chrono::steady_clock::now ();
+      generator->Run (Seconds (time), writer);
+      std::cout << generator->GetThreads () << " threads" << std::endl;
+    }
+  else
+    {
+      std::ostringstream speedRv;
+      speedRv << "ns3::ConstantRandomVariable[Constant=" << speed << "]";
+      Ptr<IntersectionsFleet> fleet = CreateObject<IntersectionsFleet> ();
+      fleet->SetAttribute ("RoadGrid", PointerValue (road));
+      fleet->SetAttribute ("Speed", StringValue (speedRv.str ()));
+      fleet->SetAttribute ("DeltaSpeed", DoubleValue (deltaSpeed));
+      fleet->SetAttribute ("Seed", UintegerValue (seed));
+      fleet->AssignStreams (stream);
+
+      writer.Track (fleet);
+      for (uint32_t i = 0; i < vehicles; i++)
+        {
+          fleet->Add (position->GetNext ());
+        }
+
+      start = std::chrono::steady_clock::now ();
+      Simulator::Stop (Seconds (time));
+      Simulator::Run ();
+      Simulator::Destroy ();
+    }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  writer.Write (output);
+  std::cout << vehicles << " vehicles, " << time << " s simulated in "
+            << elapsed.count () << " s" << std::endl
+            << writer.GetWaypoints () << " waypoints written to " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,393 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "trajectory-trace.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/callback.h"
+#include "ns3/assert.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TrajectoryTrace");
+
+NS_OBJECT_ENSURE_REGISTERED (TrajectoryTraceFile);
+
+static const char g_magic[8] = { 'M', 'K', 'V', 'T', 'R', 'C', '0', '1' };
+
+static void
+PutVarint (std::vector<uint8_t> &bytes, int64_t value)
+{
+  // zigzag, so that small negative deltas stay short
+  uint64_t v = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+  while (v >= 0x80)
+    {
+      bytes.push_back ((uint8_t) (v | 0x80));
+      v >>= 7;
+    }
+  bytes.push_back ((uint8_t) v);
+}
+
+static int64_t
+GetVarint (const uint8_t *&data, const uint8_t *end)
+{
+  uint64_t v = 0;
+  int shift = 0;
+  // a corrupt stream must not read past the end, nor shift past 64 bits
+  NS_ABORT_MSG_IF (data >= end, "TrajectoryTraceCursor: the trace ends within a waypoint");
+  while (*data & 0x80)
+    {
+      v |= (uint64_t) (*data++ & 0x7f) << shift;
+      shift += 7;
+      NS_ABORT_MSG_IF (shift >= 64, "TrajectoryTraceCursor: a value of the trace is longer than 64 bits");
+      NS_ABORT_MSG_IF (data >= end, "TrajectoryTraceCursor: the trace ends within a waypoint");
+    }
+  v |= (uint64_t) *data++ << shift;
+  return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+TrajectoryTraceWriter::TrajectoryTraceWriter ()
+  : m_timeResolution (1e-3),
+    m_positionResolution (1e-3),
+    m_velocityResolution (1e-4)
+{
+}
+
+void
+TrajectoryTraceWriter::SetResolution (Time time, double position, double velocity)
+{
+  NS_ASSERT_MSG (GetWaypoints () == 0, "the resolution cannot change once waypoints are added");
+  m_timeResolution = time.GetSeconds ();
+  m_positionResolution = position;
+  m_velocityResolution = velocity;
+}
+
+void
+TrajectoryTraceWriter::Reserve (uint32_t vehicles)
+{
+  if (vehicles > m_streams.size ())
+    {
+      Stream s;
+      s.waypoints = 0;
+      std::memset (s.last, 0, sizeof (s.last));
+      m_streams.resize (vehicles, s);
+    }
+}
+
+void
+TrajectoryTraceWriter::Add (uint32_t vehicle, Time time, const Vector &position, const Vector &velocity)
+{
+  AddSeconds (vehicle, time.GetSeconds (), position, velocity);
+}
+
+void
+TrajectoryTraceWriter::AddSeconds (uint32_t vehicle, double time, const Vector &position, const Vector &velocity)
+{
+  if (vehicle >= m_streams.size ())
+    {
+      Reserve (vehicle + 1);
+    }
+  Stream &s = m_streams[vehicle];
+  // deltas of rounded values, so the rounding errors do not add up
+  int64_t value[5];
+  value[0] = std::llround (time / m_timeResolution);
+  value[1] = std::llround (position.x / m_positionResolution);
+  value[2] = std::llround (position.y / m_positionResolution);
+  value[3] = std::llround (velocity.x / m_velocityResolution);
+  value[4] = std::llround (velocity.y / m_velocityResolution);
+  NS_ASSERT_MSG (value[0] >= s.last[0], "waypoints of a vehicle must come in time order");
+  for (int k = 0; k < 5; k++)
+    {
+      PutVarint (s.bytes, value[k] - s.last[k]);
+      s.last[k] = value[k];
+    }
+  s.waypoints++;
+}
+
+void
+TrajectoryTraceWriter::Track (uint32_t vehicle, Ptr<MobilityModel> model)
+{
+  Add (vehicle, Simulator::Now (), model->GetPosition (), model->GetVelocity ());
+  model->TraceConnectWithoutContext ("CourseChange",
+                                     MakeBoundCallback (&TrajectoryTraceWriter::CourseChanged, this, vehicle));
+}
+
+void
+TrajectoryTraceWriter::Track (Ptr<IntersectionsFleet> fleet)
+{
+  for (uint32_t i = 0; i < fleet->GetN (); i++)
+    {
+      Add (i, Simulator::Now (), fleet->GetPosition (i), fleet->GetVelocity (i));
+    }
+  fleet->TraceConnectWithoutContext ("CourseChange",
+                                     MakeBoundCallback (&TrajectoryTraceWriter::FleetCourseChanged, this, PeekPointer (fleet)));
+}
+
+void
+TrajectoryTraceWriter::CourseChanged (TrajectoryTraceWriter *writer, uint32_t vehicle, Ptr<const MobilityModel> model)
+{
+  writer->Add (vehicle, Simulator::Now (), model->GetPosition (), model->GetVelocity ());
+}
+
+void
+TrajectoryTraceWriter::FleetCourseChanged (TrajectoryTraceWriter *writer, IntersectionsFleet *fleet, uint32_t vehicle)
+{
+  writer->Add (vehicle, Simulator::Now (), fleet->GetPosition (vehicle), fleet->GetVelocity (vehicle));
+}
+
+uint32_t
+TrajectoryTraceWriter::GetN (void) const
+{
+  return m_streams.size ();
+}
+
+uint64_t
+TrajectoryTraceWriter::GetWaypoints (void) const
+{
+  uint64_t waypoints = 0;
+  for (uint32_t i = 0; i < m_streams.size (); i++)
+    {
+      waypoints += m_streams[i].waypoints;
+    }
+  return waypoints;
+}
+
+void
+TrajectoryTraceWriter::Write (std::string filename) const
+{
+  NS_LOG_FUNCTION (this << filename);
+  std::ofstream file (filename.c_str (), std::ios::binary | std::ios::trunc);
+  if (!file.is_open ())
+    {
+      NS_FATAL_ERROR ("TrajectoryTraceWriter: cannot open " << filename);
+    }
+
+  TrajectoryTraceHeader header;
+  std::memcpy (header.magic, g_magic, sizeof (header.magic));
+  header.vehicles = m_streams.size ();
+  header.flags = 0;
+  header.timeResolution = m_timeResolution;
+  header.positionResolution = m_positionResolution;
+  header.velocityResolution = m_velocityResolution;
+  file.write ((const char *) &header, sizeof (header));
+
+  std::vector<TrajectoryTraceIndex> index (m_streams.size ());
+  uint64_t offset = sizeof (header) + index.size () * sizeof (TrajectoryTraceIndex);
+  for (uint32_t i = 0; i < m_streams.size (); i++)
+    {
+      index[i].offset = offset;
+      index[i].waypoints = m_streams[i].waypoints;
+      offset += m_streams[i].bytes.size ();
+    }
+  if (!index.empty ())
+    {
+      file.write ((const char *) &index[0], index.size () * sizeof (TrajectoryTraceIndex));
+    }
+  for (uint32_t i = 0; i < m_streams.size (); i++)
+    {
+      if (!m_streams[i].bytes.empty ())
+        {
+          file.write ((const char *) &m_streams[i].bytes[0], m_streams[i].bytes.size ());
+        }
+    }
+  if (!file)
+    {
+      NS_FATAL_ERROR ("TrajectoryTraceWriter: cannot write " << filename);
+    }
+}
+
+
+TrajectoryTraceCursor::TrajectoryTraceCursor ()
+  : m_data (0),
+    m_end (0),
+    m_remaining (0),
+    m_timeResolution (0),
+    m_positionResolution (0),
+    m_velocityResolution (0)
+{
+  std::memset (m_last, 0, sizeof (m_last));
+}
+
+TrajectoryTraceCursor::TrajectoryTraceCursor (const TrajectoryTraceHeader &header, const uint8_t *data,
+                                              uint64_t size, const TrajectoryTraceIndex &index)
+  : m_data (data + index.offset),
+    m_end (data + size),
+    m_remaining (index.waypoints),
+    m_timeResolution (header.timeResolution),
+    m_positionResolution (header.positionResolution),
+    m_velocityResolution (header.velocityResolution)
+{
+  std::memset (m_last, 0, sizeof (m_last));
+}
+
+bool
+TrajectoryTraceCursor::Next (Time &time, Vector &position, Vector &velocity)
+{
+  if (m_remaining == 0)
+    {
+      return false;
+    }
+  for (int k = 0; k < 5; k++)
+    {
+      m_last[k] += GetVarint (m_data, m_end);
+    }
+  m_remaining--;
+  time = Seconds (m_last[0] * m_timeResolution);
+  position = Vector (m_last[1] * m_positionResolution, m_last[2] * m_positionResolution, 0);
+  velocity = Vector (m_last[3] * m_velocityResolution, m_last[4] * m_velocityResolution, 0);
+  return true;
+}
+
+uint64_t
+TrajectoryTraceCursor::GetRemaining (void) const
+{
+  return m_remaining;
+}
+
+
+
+TypeId
+TrajectoryTraceFile::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TrajectoryTraceFile")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<TrajectoryTraceFile> ()
+    .AddAttribute ("Filename", "The trajectory trace file to map.",
+                   StringValue (""),
+                   MakeStringAccessor (&TrajectoryTraceFile::Open,
+                                       &TrajectoryTraceFile::GetFilename),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+TrajectoryTraceFile::TrajectoryTraceFile ()
+  : m_data (0),
+    m_size (0),
+    m_index (0),
+    m_next (0)
+{
+  std::memset (&m_header, 0, sizeof (m_header));
+}
+
+TrajectoryTraceFile::~TrajectoryTraceFile ()
+{
+  Close ();
+}
+
+void
+TrajectoryTraceFile::DoDispose (void)
+{
+  Close ();
+  Object::DoDispose ();
+}
+
+void
+TrajectoryTraceFile::Close (void)
+{
+  if (m_data != 0)
+    {
+      munmap ((void *) m_data, m_size);
+      m_data = 0;
+      m_size = 0;
+      m_index = 0;
+    }
+}
+
+void
+TrajectoryTraceFile::Open (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  Close ();
+  m_filename = filename;
+  m_next = 0;
+  if (filename.empty ())
+    {
+      return;
+    }
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      NS_FATAL_ERROR ("TrajectoryTraceFile: cannot open " << filename);
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (uint64_t) st.st_size < sizeof (TrajectoryTraceHeader))
+    {
+      close (fd);
+      NS_FATAL_ERROR ("TrajectoryTraceFile: " << filename << " is not a trajectory trace");
+    }
+  void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      NS_FATAL_ERROR ("TrajectoryTraceFile: cannot map " << filename);
+    }
+  m_data = (const uint8_t *) data;
+  m_size = st.st_size;
+
+  std::memcpy (&m_header, m_data, sizeof (m_header));
+  if (std::memcmp (m_header.magic, g_magic, sizeof (g_magic)) != 0
+      || m_size < sizeof (m_header) + (uint64_t) m_header.vehicles * sizeof (TrajectoryTraceIndex))
+    {
+      Close ();
+      NS_FATAL_ERROR ("TrajectoryTraceFile: " << filename << " is not a trajectory trace");
+    }
+  m_index = (const TrajectoryTraceIndex *) (m_data + sizeof (m_header));
+}
+
+std::string
+TrajectoryTraceFile::GetFilename (void) const
+{
+  return m_filename;
+}
+
+uint32_t
+TrajectoryTraceFile::GetN (void) const
+{
+  return m_data != 0 ? m_header.vehicles : 0;
+}
+
+TrajectoryTraceCursor
+TrajectoryTraceFile::GetCursor (uint32_t vehicle) const
+{
+  NS_ABORT_MSG_UNLESS (vehicle < GetN (), "TrajectoryTraceFile: no vehicle " << vehicle << " in " << m_filename);
+  // the stream of the vehicle lies after the index, and each of its
+  // waypoints takes at least one byte per value
+  const TrajectoryTraceIndex &index = m_index[vehicle];
+  uint64_t start = sizeof (m_header) + (uint64_t) m_header.vehicles * sizeof (TrajectoryTraceIndex);
+  NS_ABORT_MSG_UNLESS (index.offset >= start && index.offset <= m_size
+                       && index.waypoints <= (m_size - index.offset) / 5,
+                       "TrajectoryTraceFile: the index entry of vehicle " << vehicle << " in "
+                       << m_filename << " does not fit the file");
+  return TrajectoryTraceCursor (m_header, m_data, m_size, index);
+}
+
+uint32_t
+TrajectoryTraceFile::AllocateVehicle (void)
+{
+  return m_next++;
+}
+
+} // namespace ns3
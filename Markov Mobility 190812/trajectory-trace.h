@@ -0,0 +1,269 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TRAJECTORY_TRACE_H
+#define TRAJECTORY_TRACE_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/vector.h"
+#include "ns3/ptr.h"
+#include "mobility-model.h"
+#include "intersections-fleet.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * Header of a trajectory trace file.
+ *
+ * A trace holds the waypoints of piecewise-linear trajectories: between
+ * two waypoints a vehicle moves at the velocity of the first one. The
+ * file is little-endian and made of
+ *  - this header,
+ *  - one TrajectoryTraceIndex per vehicle,
+ *  - the waypoints of each vehicle, one stream after the other.
+ *
+ * A waypoint is five zigzag LEB128 varints: time, x, y, velocity x and
+ * velocity y, each in units of its resolution and relative to the
+ * previous waypoint of the same vehicle (to zero for the first one).
+ */
+struct TrajectoryTraceHeader
+{
+  char magic[8];              //!< "MKVTRC01"
+  uint32_t vehicles;          //!< number of vehicles
+  uint32_t flags;             //!< reserved, 0
+  double timeResolution;      //!< seconds per time unit
+  double positionResolution;  //!< meters per position unit
+  double velocityResolution;  //!< m/s per velocity unit
+};
+
+/**
+ * \ingroup mobility
+ * Where the waypoints of a vehicle are in a trajectory trace file.
+ */
+struct TrajectoryTraceIndex
+{
+  uint64_t offset;            //!< offset of the first waypoint from the start of the file
+  uint64_t waypoints;         //!< number of waypoints
+};
+
+/**
+ * \ingroup mobility
+ * \brief Records waypoints and writes them as a trajectory trace file.
+ *
+ * The waypoints are kept encoded in memory, one stream per vehicle,
+ * until Write. The writer must outlive the models and fleets it tracks.
+ *
+ * Adding a waypoint only touches the stream of its vehicle: once Reserve
+ * made room for them, different vehicles can be added from different
+ * threads.
+ */
+class TrajectoryTraceWriter
+{
+public:
+  TrajectoryTraceWriter ();
+
+  /**
+   * \param time the duration of a time unit
+   * \param position the length of a position unit, in meters
+   * \param velocity the speed of a velocity unit, in m/s
+   *
+   * Must be called before the first waypoint is added.
+   */
+  void SetResolution (Time time, double position, double velocity);
+
+  /**
+   * \param vehicle the index of the vehicle
+   * \param time the time of the waypoint, not before the previous one of the vehicle
+   * \param position the position of the vehicle
+   * \param velocity the velocity of the vehicle from now to its next waypoint
+   */
+  void Add (uint32_t vehicle, Time time, const Vector &position, const Vector &velocity);
+  /**
+   * Like Add, with the time in seconds, which does not need a Time.
+   *
+   * \param vehicle the index of the vehicle
+   * \param time the time of the waypoint in seconds, not before the previous one of the vehicle
+   * \param position the position of the vehicle
+   * \param velocity the velocity of the vehicle from now to its next waypoint
+   */
+  void AddSeconds (uint32_t vehicle, double time, const Vector &position, const Vector &velocity);
+  /**
+   * \param vehicles make room for the vehicles below this index
+   */
+  void Reserve (uint32_t vehicles);
+  /**
+   * Record a waypoint now and on every CourseChange of a model.
+   *
+   * \param vehicle the index of the vehicle
+   * \param model its mobility model
+   */
+  void Track (uint32_t vehicle, Ptr<MobilityModel> model);
+  /**
+   * Record a waypoint now for every vehicle of a fleet, and then on every
+   * course change of its vehicles, with their fleet index as vehicle index.
+   *
+   * \param fleet the fleet
+   */
+  void Track (Ptr<IntersectionsFleet> fleet);
+
+  /**
+   * \return the number of vehicles, one more than the highest index added
+   */
+  uint32_t GetN (void) const;
+  /**
+   * \return the number of waypoints added
+   */
+  uint64_t GetWaypoints (void) const;
+
+  /**
+   * \param filename the file to write the trace to
+   */
+  void Write (std::string filename) const;
+
+private:
+  /** The encoded waypoints of a vehicle, and the last one for the deltas. */
+  struct Stream
+  {
+    std::vector<uint8_t> bytes; //!< encoded waypoints
+    uint64_t waypoints;         //!< number of waypoints
+    int64_t last[5];            //!< last time, position and velocity, in units
+  };
+
+  /**
+   * Trace sink of the CourseChange of a tracked model.
+   */
+  static void CourseChanged (TrajectoryTraceWriter *writer, uint32_t vehicle, Ptr<const MobilityModel> model);
+  /**
+   * Trace sink of the CourseChange of a tracked fleet.
+   */
+  static void FleetCourseChanged (TrajectoryTraceWriter *writer, IntersectionsFleet *fleet, uint32_t vehicle);
+
+  double m_timeResolution;      //!< seconds per time unit
+  double m_positionResolution;  //!< meters per position unit
+  double m_velocityResolution;  //!< m/s per velocity unit
+  std::vector<Stream> m_streams; //!< one stream per vehicle
+};
+
+/**
+ * \ingroup mobility
+ * \brief Walks through the waypoints of one vehicle of a trajectory trace.
+ *
+ * Only keeps a pointer into the encoded stream and the last waypoint,
+ * so it can run over a memory-mapped file. It never reads past the end
+ * of the file: a truncated or corrupt trace aborts the simulation.
+ */
+class TrajectoryTraceCursor
+{
+public:
+  TrajectoryTraceCursor ();
+  /**
+   * \param header the header of the trace
+   * \param data the start of the trace file
+   * \param size the size of the trace file
+   * \param index the index entry of the vehicle
+   */
+  TrajectoryTraceCursor (const TrajectoryTraceHeader &header, const uint8_t *data,
+                         uint64_t size, const TrajectoryTraceIndex &index);
+
+  /**
+   * \param time set to the time of the next waypoint
+   * \param position set to its position
+   * \param velocity set to its velocity
+   * \return false if there are no waypoints left
+   */
+  bool Next (Time &time, Vector &position, Vector &velocity);
+  /**
+   * \return the number of waypoints not read yet
+   */
+  uint64_t GetRemaining (void) const;
+
+private:
+  const uint8_t *m_data;        //!< next encoded waypoint
+  const uint8_t *m_end;         //!< end of the trace file
+  uint64_t m_remaining;         //!< waypoints not read yet
+  int64_t m_last[5];            //!< last time, position and velocity, in units
+  double m_timeResolution;      //!< seconds per time unit
+  double m_positionResolution;  //!< meters per position unit
+  double m_velocityResolution;  //!< m/s per velocity unit
+};
+
+/**
+ * \ingroup mobility
+ * \brief A trajectory trace file mapped in memory.
+ *
+ * Opening the file only maps it and checks its header; the waypoints of
+ * a vehicle are read in place, through a TrajectoryTraceCursor, and the
+ * pages they are on are only loaded when they are read. One instance is
+ * shared by all the TraceReplayMobilityModel of a scenario.
+ */
+class TrajectoryTraceFile : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  TrajectoryTraceFile ();
+  virtual ~TrajectoryTraceFile ();
+
+  /**
+   * \param filename the trace file to map
+   */
+  void Open (std::string filename);
+  /**
+   * \return the name of the mapped file
+   */
+  std::string GetFilename (void) const;
+  /**
+   * \return the number of vehicles in the trace
+   */
+  uint32_t GetN (void) const;
+  /**
+   * Aborts if the index entry of the vehicle points outside the file, or
+   * announces more waypoints than the rest of the file can hold.
+   *
+   * \param vehicle the index of a vehicle
+   * \return a cursor on its first waypoint
+   */
+  TrajectoryTraceCursor GetCursor (uint32_t vehicle) const;
+  /**
+   * \return the index of the first vehicle not handed out yet
+   */
+  uint32_t AllocateVehicle (void);
+
+private:
+  virtual void DoDispose (void);
+  /**
+   * Unmap the file.
+   */
+  void Close (void);
+
+  std::string m_filename;         //!< name of the mapped file
+  const uint8_t *m_data;          //!< the mapped file
+  uint64_t m_size;                //!< size of the mapped file
+  TrajectoryTraceHeader m_header; //!< header of the file
+  const TrajectoryTraceIndex *m_index; //!< index of the file
+  uint32_t m_next;                //!< next vehicle to hand out
+};
+
+} // namespace ns3
+
+#endif /* TRAJECTORY_TRACE_H */
@@ -0,0 +1,236 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "turn-matrix.h"
+#include "ns3/pointer.h"
+#include "ns3/string.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TurnMatrix");
+
+NS_OBJECT_ENSURE_REGISTERED (TurnMatrix);
+
+// heading after a rebound
+static const uint8_t g_reversed[4] = { 1, 0, 3, 2 };
+// axis and direction of travel of each heading: 0 +y, 1 -y, 2 -x, 3 +x
+static const int g_axis[4] = { 1, 1, 0, 0 };
+static const int64_t g_step[4] = { 1, -1, -1, 1 };
+
+TypeId
+TurnMatrix::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TurnMatrix")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<TurnMatrix> ()
+    .AddAttribute ("RoadGrid", "The road layout whose intersections the table covers.",
+                   PointerValue (),
+                   MakePointerAccessor (&TurnMatrix::SetRoadGrid,
+                                        &TurnMatrix::GetRoadGrid),
+                   MakePointerChecker<RoadGrid> ())
+    .AddAttribute ("Filename", "A file of turning ratios to load, see TurnMatrix::Load.",
+                   StringValue (""),
+                   MakeStringAccessor (&TurnMatrix::Load,
+                                       &TurnMatrix::GetFilename),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+TurnMatrix::TurnMatrix ()
+  : m_n (0),
+    m_centre (0)
+{
+}
+
+TurnMatrix::~TurnMatrix ()
+{
+}
+
+void
+TurnMatrix::DoDispose (void)
+{
+  m_roadGrid = 0;
+  Object::DoDispose ();
+}
+
+void
+TurnMatrix::SetRoadGrid (Ptr<RoadGrid> roadGrid)
+{
+  m_roadGrid = roadGrid;
+  m_table.clear ();
+  m_n = 0;
+  if (m_roadGrid != 0)
+    {
+      m_n = m_roadGrid->GetIntersection ();
+      m_centre = m_roadGrid->GetLines ().centre;
+      TurnAlias uniform;
+      double weight[3] = { 1, 1, 1 };
+      uniform.Build (weight);
+      m_table.assign (m_n * m_n * 12, uniform);
+    }
+}
+
+Ptr<RoadGrid>
+TurnMatrix::GetRoadGrid (void) const
+{
+  return m_roadGrid;
+}
+
+void
+TurnMatrix::Set (uint32_t i, uint32_t j, uint8_t heading, uint8_t previous,
+                 double straight, double right, double left)
+{
+  NS_ABORT_MSG_IF (i >= m_n || j >= m_n || heading >= 4 || previous >= 3,
+                   "TurnMatrix: no entry (" << i << ", " << j << ", " << (int) heading
+                   << ", " << (int) previous << ")");
+  NS_ABORT_MSG_IF (straight < 0 || right < 0 || left < 0 || straight + right + left <= 0,
+                   "TurnMatrix: invalid weights");
+  double weight[3] = { straight, right, left };
+  m_table[GetIndex (i, j, heading, previous)].Build (weight);
+}
+
+void
+TurnMatrix::Load (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  m_filename = filename;
+  if (filename.empty ())
+    {
+      return;
+    }
+  NS_ABORT_MSG_IF (m_roadGrid == 0, "TurnMatrix: no RoadGrid set");
+  std::ifstream file (filename.c_str ());
+  if (!file.is_open ())
+    {
+      NS_FATAL_ERROR ("TurnMatrix: cannot open " << filename);
+    }
+  std::string line;
+  uint32_t number = 0;
+  while (std::getline (file, line))
+    {
+      number++;
+      std::istringstream fields (line);
+      std::string key[4];
+      double weight[3];
+      if (!(fields >> key[0]) || key[0][0] == '#')
+        {
+          continue;
+        }
+      if (!(fields >> key[1] >> key[2] >> key[3] >> weight[0] >> weight[1] >> weight[2]))
+        {
+          NS_FATAL_ERROR ("TurnMatrix: " << filename << ":" << number << ": expected "
+                          "\"i j heading previous straight right left\"");
+        }
+      // the range of each key, all of it for a wildcard
+      uint32_t size[4] = { m_n, m_n, 4, 3 };
+      uint32_t first[4];
+      uint32_t last[4];
+      for (int k = 0; k < 4; k++)
+        {
+          if (key[k] == "*")
+            {
+              first[k] = 0;
+              last[k] = size[k];
+              continue;
+            }
+          char *end;
+          first[k] = std::strtoul (key[k].c_str (), &end, 10);
+          last[k] = first[k] + 1;
+          if (*end != 0 || first[k] >= size[k])
+            {
+              NS_FATAL_ERROR ("TurnMatrix: " << filename << ":" << number << ": invalid field " << key[k]);
+            }
+        }
+      for (uint32_t i = first[0]; i < last[0]; i++)
+        {
+          for (uint32_t j = first[1]; j < last[1]; j++)
+            {
+              for (uint32_t h = first[2]; h < last[2]; h++)
+                {
+                  for (uint32_t p = first[3]; p < last[3]; p++)
+                    {
+                      Set (i, j, h, p, weight[0], weight[1], weight[2]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+std::string
+TurnMatrix::GetFilename (void) const
+{
+  return m_filename;
+}
+
+Vector
+TurnMatrix::GetProbability (uint32_t i, uint32_t j, uint8_t heading, uint8_t previous) const
+{
+  NS_ABORT_MSG_IF (i >= m_n || j >= m_n || heading >= 4 || previous >= 3, "TurnMatrix: no such entry");
+  return GetProbability (GetIndex (i, j, heading, previous));
+}
+
+Vector
+TurnMatrix::GetProbability (uint32_t entry) const
+{
+  const TurnAlias &a = m_table[entry];
+  // each column holds a third of the probability, shared with its alias
+  double p[3] = { 0, 0, 0 };
+  for (uint8_t k = 0; k < 3; k++)
+    {
+      double keep = a.alias[k] == k ? 1 : a.threshold[k] / 4294967296.0;
+      p[k] += keep;
+      p[a.alias[k]] += 1 - keep;
+    }
+  return Vector (100 * p[0] / 3, 100 * p[1] / 3, 100 * p[2] / 3);
+}
+
+uint8_t
+TurnMatrix::Sample (const Vector &position, uint8_t heading, uint8_t previous, bool turned, double u,
+                    uint32_t &entry) const
+{
+  double offset[2];
+  int64_t block[2];
+  block[0] = m_roadGrid->GetBlock (position.x, offset[0]);
+  block[1] = m_roadGrid->GetBlock (position.y, offset[1]);
+  int axis = g_axis[heading];
+  int64_t step = g_step[heading];
+  // the intersection of a block is on its centre-line
+  int64_t next = block[axis];
+  if (turned || (offset[axis] - m_centre) * step > 0)
+    {
+      next += step;
+    }
+  if ((uint64_t) next >= m_n)
+    {
+      // the vehicle rebounds before it gets there
+      next = block[axis];
+      heading = g_reversed[heading];
+    }
+  block[axis] = next;
+  uint32_t i = std::min ((uint64_t) std::max (block[0], (int64_t) 0), (uint64_t) m_n - 1);
+  uint32_t j = std::min ((uint64_t) std::max (block[1], (int64_t) 0), (uint64_t) m_n - 1);
+  entry = GetIndex (i, j, heading, previous);
+  return m_table[entry].Sample (u);
+}
+
+} // namespace ns3
@@ -0,0 +1,144 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TURN_MATRIX_H
+#define TURN_MATRIX_H
+
+#include "ns3/object.h"
+#include "ns3/vector.h"
+#include "road-grid.h"
+#include "turn-pool.h"
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Turning ratios by intersection, approach and previous turn.
+ *
+ * Holds one distribution of the next turn for every intersection of a
+ * RoadGrid, every heading a vehicle can approach it with (numbered like
+ * RoadGrid::Place::heading: 0 +y, 1 -y, 2 -x, 3 +x) and every turn the vehicle took at the
+ * intersection before (0 straight, 1 right, 2 left). The distributions
+ * are alias tables in a single array, 12 per intersection, shared by all
+ * the vehicles: a draw is an index computation and one comparison.
+ *
+ * When Intersections or IntersectionsFleet are given a TurnMatrix, the
+ * turn a vehicle takes at an intersection is drawn from it instead of
+ * from the Markov counters of the vehicle, which are then not kept at all.
+ * Entries that are not set turn each way with the same probability.
+ */
+class TurnMatrix : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  TurnMatrix ();
+  virtual ~TurnMatrix ();
+
+  /**
+   * Resize the table to the intersections of a road layout; every entry
+   * is reset.
+   *
+   * \param roadGrid the road layout
+   */
+  void SetRoadGrid (Ptr<RoadGrid> roadGrid);
+  /**
+   * \return the road layout
+   */
+  Ptr<RoadGrid> GetRoadGrid (void) const;
+
+  /**
+   * \param i the column of the intersection
+   * \param j the row of the intersection
+   * \param heading the heading the vehicles approach it with
+   * \param previous the turn they took at the intersection before
+   * \param straight the weight of going straight
+   * \param right the weight of turning right
+   * \param left the weight of turning left
+   */
+  void Set (uint32_t i, uint32_t j, uint8_t heading, uint8_t previous,
+            double straight, double right, double left);
+  /**
+   * \brief Set entries from a text file
+   *
+   * Each line holds "i j heading previous straight right left"; any of the
+   * first four fields can be '*' to set every value of it. Lines are applied
+   * in order, so a line can override part of a wildcard line before it.
+   * Empty lines and lines starting with '#' are skipped.
+   *
+   * \param filename the file to read
+   */
+  void Load (std::string filename);
+  /**
+   * \return the name of the last file loaded
+   */
+  std::string GetFilename (void) const;
+
+  /**
+   * \param i the column of the intersection
+   * \param j the row of the intersection
+   * \param heading the heading the vehicles approach it with
+   * \param previous the turn they took at the intersection before
+   * \return the straight, right and left percentages
+   */
+  Vector GetProbability (uint32_t i, uint32_t j, uint8_t heading, uint8_t previous) const;
+  /**
+   * \param entry an entry returned by Sample
+   * \return its straight, right and left percentages
+   */
+  Vector GetProbability (uint32_t entry) const;
+
+  /**
+   * \brief Draw the turn at the next intersection of a vehicle
+   *
+   * If the vehicle is about to rebound on the boundary of the layout,
+   * the next intersection is the one it comes back to, heading the other way.
+   *
+   * \param position the position of the vehicle
+   * \param heading its heading, numbered like RoadGrid::Place::heading
+   * \param previous the turn it took at the last intersection
+   * \param turned true if it is at the intersection it just turned at
+   * \param u a uniform value in [0, 3)
+   * \param entry set to the entry the turn was drawn from
+   * \return the turn: 0 straight, 1 right, 2 left
+   */
+  uint8_t Sample (const Vector &position, uint8_t heading, uint8_t previous, bool turned, double u,
+                  uint32_t &entry) const;
+
+private:
+  virtual void DoDispose (void);
+  /**
+   * \return the index in m_table of an entry
+   */
+  uint32_t GetIndex (uint32_t i, uint32_t j, uint8_t heading, uint8_t previous) const
+  {
+    return ((j * m_n + i) * 4 + heading) * 3 + previous;
+  }
+
+  Ptr<RoadGrid> m_roadGrid; //!< road layout
+  uint32_t m_n; //!< number of intersections on each axis
+  double m_centre; //!< offset of the intersections inside their block
+  std::string m_filename; //!< last file loaded
+  std::vector<TurnAlias> m_table; //!< distributions, by intersection, heading and previous turn
+};
+
+} // namespace ns3
+
+#endif /* TURN_MATRIX_H */
@@ -0,0 +1,207 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "turn-pool.h"
+#include "ns3/assert.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TurnPool");
+
+NS_OBJECT_ENSURE_REGISTERED (TurnPool);
+
+void
+TurnAlias::Build (const double weight[3])
+{
+  double total = weight[0] + weight[1] + weight[2];
+  NS_ASSERT (total > 0);
+  double scale = 3 / total;
+  // Walker's construction has a closed form with three columns: the
+  // largest weight tops up the others, and is itself topped up by the
+  // middle one if that one is above average too
+  uint8_t l = weight[0] >= weight[1] ? (weight[0] >= weight[2] ? 0 : 2) : (weight[1] >= weight[2] ? 1 : 2);
+  uint8_t a = (l + 1) % 3;
+  uint8_t b = (l + 2) % 3;
+  if (weight[a] < weight[b])
+    {
+      std::swap (a, b);
+    }
+  double sa = weight[a] * scale;
+  double prob[3];
+  alias[l] = l;
+  alias[a] = l;
+  alias[b] = l;
+  prob[l] = 1;
+  prob[b] = weight[b] * scale;
+  if (sa < 1)
+    {
+      prob[a] = sa;
+    }
+  else
+    {
+      prob[a] = 1;
+      alias[a] = a;
+      prob[l] = 2 - sa;
+      alias[l] = a;
+    }
+  for (uint8_t k = 0; k < 3; k++)
+    {
+      // a full column keeps its own turn whatever the threshold
+      threshold[k] = (uint32_t) std::min (prob[k] * 4294967296.0, 4294967295.0);
+    }
+}
+
+TypeId
+TurnPool::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TurnPool")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<TurnPool> ()
+  ;
+  return tid;
+}
+
+TurnPool::TurnPool ()
+  : m_users (0)
+{
+  // row a holds the right percentages 0 to 100 - a, see GetTable
+  m_tables.reserve (101 * 102 / 2);
+  for (uint32_t straight = 0; straight <= 100; straight++)
+    {
+      for (uint32_t right = 0; straight + right <= 100; right++)
+        {
+          m_tables.push_back (GetAlias (straight, right));
+        }
+    }
+}
+
+TurnPool::~TurnPool ()
+{
+}
+
+Ptr<TurnPool>
+TurnPool::GetDefault (void)
+{
+  static Ptr<TurnPool> pool = CreateObject<TurnPool> ();
+  return pool;
+}
+
+TurnAlias
+TurnPool::GetAlias (uint32_t straight, uint32_t right)
+{
+  // the thresholds of Intersections::ChangedDirection, as a distribution
+  double first = std::min (straight >= 5 ? straight : 5, (uint32_t) 100);
+  double second = std::min (right >= 5 ? straight + right : straight + 5, (uint32_t) 100);
+  double weight[3];
+  weight[0] = first;
+  weight[1] = std::max (second - first, 0.0);
+  weight[2] = std::max (100 - weight[0] - weight[1], 0.0);
+  TurnAlias alias;
+  alias.Build (weight);
+  return alias;
+}
+
+TurnAlias
+TurnPool::GetAlias (const uint32_t p[3])
+{
+  uint32_t num = p[0] + p[1] + p[2];
+  NS_ABORT_MSG_IF (num == 0, "TurnPool: no turn counted");
+  NS_ABORT_MSG_IF (num >= (1 << 21), "TurnPool: turn count overflow");
+  return GetAlias (100 * p[0] / num, 100 * p[1] / num);
+}
+
+uint16_t
+TurnPool::GetTable (const uint32_t p[3])
+{
+  uint32_t num = p[0] + p[1] + p[2];
+  NS_ASSERT (num > 0);
+  // the floored percentages never add up to more than 100
+  uint32_t straight = 100 * p[0] / num;
+  uint32_t right = 100 * p[1] / num;
+  return straight * 101 - straight * (straight - 1) / 2 + right;
+}
+
+void
+TurnPool::Start (TurnCounts &counts, uint32_t p1, uint32_t p2, uint32_t p3) const
+{
+  NS_ABORT_MSG_IF (p1 + p2 + p3 == 0, "TurnPool: no turn counted");
+  NS_ABORT_MSG_IF (p1 > 0xffff || p2 > 0xffff || p3 > 0xffff, "TurnPool: turn count overflow");
+  uint32_t p[3] = { p1, p2, p3 };
+  counts.p[0] = p1;
+  counts.p[1] = p2;
+  counts.p[2] = p3;
+  counts.table = GetTable (p);
+}
+
+void
+TurnPool::Count (TurnCounts &counts, uint8_t turn) const
+{
+  NS_ASSERT (turn < 3);
+  if (counts.p[turn] == 0xffff)
+    {
+      // rounded up, so a turn counted once stays possible
+      for (uint32_t k = 0; k < 3; k++)
+        {
+          counts.p[k] = (counts.p[k] + 1) / 2;
+        }
+    }
+  counts.p[turn]++;
+  uint32_t p[3] = { counts.p[0], counts.p[1], counts.p[2] };
+  counts.table = GetTable (p);
+}
+
+Vector
+TurnPool::GetProbability (const TurnCounts &counts)
+{
+  double num = counts.p[0] + counts.p[1] + counts.p[2];
+  return Vector (100 * counts.p[0]/num, 100 * counts.p[1]/num, 100 * counts.p[2]/num);
+}
+
+uint32_t
+TurnPool::GetN (void) const
+{
+  return m_tables.size ();
+}
+
+uint32_t
+TurnPool::GetMemoryUsage (void) const
+{
+  return sizeof (*this) + m_tables.capacity () * sizeof (TurnAlias);
+}
+
+void
+TurnPool::AddUsers (uint32_t n)
+{
+  m_users += n;
+}
+
+void
+TurnPool::RemoveUsers (uint32_t n)
+{
+  // a model given another pool after it started is counted on the first one
+  m_users -= std::min (n, m_users);
+}
+
+uint32_t
+TurnPool::GetUsers (void) const
+{
+  return m_users;
+}
+
+} // namespace ns3
@@ -0,0 +1,178 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TURN_POOL_H
+#define TURN_POOL_H
+
+#include "ns3/object.h"
+#include "ns3/vector.h"
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Alias table (Walker's method) of a distribution over the three turns.
+ *
+ * A turn is drawn from a single uniform value with one comparison, whatever
+ * the distribution.
+ */
+struct TurnAlias
+{
+  /**
+   * \param weight the weights of going straight, turning right and turning left
+   */
+  void Build (const double weight[3]);
+  /**
+   * \param u a uniform value in [0, 3)
+   * \return the turn: 0 straight, 1 right, 2 left
+   */
+  uint8_t Sample (double u) const
+  {
+    uint32_t k = std::min ((uint32_t) u, (uint32_t) 2);
+    return (uint32_t) ((u - k) * 4294967296.0) < threshold[k] ? k : alias[k];
+  }
+
+  uint32_t threshold[3]; //!< probability of keeping each column, in units of 2^-32
+  uint8_t alias[3];      //!< turn taken otherwise
+};
+
+/**
+ * \ingroup mobility
+ * \brief The Markov turn counters of a vehicle, packed in 8 bytes.
+ *
+ * The counts stay with the vehicle; table is the index of the
+ * distribution of its next turn in the TurnPool, which TurnPool::Count
+ * moves along with the counts.
+ */
+struct TurnCounts
+{
+  uint16_t p[3];  //!< straight, right and left counts
+  uint16_t table; //!< distribution of the next turn in the TurnPool
+};
+
+/**
+ * \ingroup mobility
+ * \brief Shared distributions of the Markov turns of the vehicles.
+ *
+ * Each vehicle counts the turns it took (Intersections::ChangeVelocity) and
+ * draws the next one in proportion, with a floor of 5% on going straight
+ * and turning right. The distribution only depends on the straight and
+ * right percentages of the counts, floored to whole percents, so the pool
+ * holds the alias table of each of the 5151 pairs of them (80 KiB), built
+ * once and never changed. A vehicle keeps its counts in a TurnCounts with
+ * the index of its table: counting a turn re-points it to another table,
+ * and drawing a turn is a lookup, both O(1) whatever the number of
+ * vehicles.
+ *
+ * Flooring the percentages leaves at most 2 percentage points to turning
+ * left that the exact counts would give to going straight or turning
+ * right. A count that would overflow 16 bits halves the three counts
+ * first, which keeps their proportions.
+ */
+class TurnPool : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  TurnPool ();
+  virtual ~TurnPool ();
+
+  /**
+   * \return the pool shared by the models that are not given one
+   */
+  static Ptr<TurnPool> GetDefault (void);
+
+  /**
+   * \param counts set to these counts and their table
+   * \param p1 the number of times the vehicle went straight
+   * \param p2 the number of times it turned right
+   * \param p3 the number of times it turned left
+   */
+  void Start (TurnCounts &counts, uint32_t p1, uint32_t p2, uint32_t p3) const;
+  /**
+   * \param counts the counts of the vehicle, and their table
+   * \param turn the turn the vehicle took, counted
+   */
+  void Count (TurnCounts &counts, uint8_t turn) const;
+
+  /**
+   * \param counts the counts of a vehicle
+   * \param u a uniform value in [0, 3)
+   * \return the turn drawn: 0 straight, 1 right, 2 left
+   */
+  uint8_t Sample (const TurnCounts &counts, double u) const
+  {
+    return m_tables[counts.table].Sample (u);
+  }
+  /**
+   * \param counts the counts of a vehicle
+   * \return its straight, right and left percentages
+   */
+  static Vector GetProbability (const TurnCounts &counts);
+  /**
+   * \return the number of distributions held
+   */
+  uint32_t GetN (void) const;
+  /**
+   * \return the bytes the pool takes, its tables included
+   */
+  uint32_t GetMemoryUsage (void) const;
+  /**
+   * \param n the number of vehicles that started drawing from the pool
+   */
+  void AddUsers (uint32_t n);
+  /**
+   * \param n the number of vehicles that no longer draw from the pool
+   */
+  void RemoveUsers (uint32_t n);
+  /**
+   * \return the number of vehicles drawing from the pool, for the memory
+   *         reports; the draws themselves do not need it
+   */
+  uint32_t GetUsers (void) const;
+
+  /**
+   * \param p the straight, right and left counts of a vehicle
+   * \return the distribution of its next turn, the one the pool holds
+   *         for these counts, without going through a pool
+   */
+  static TurnAlias GetAlias (const uint32_t p[3]);
+
+private:
+  /**
+   * \param p the straight, right and left counts, not all 0
+   * \return the index of their distribution in m_tables
+   */
+  static uint16_t GetTable (const uint32_t p[3]);
+  /**
+   * \param straight the straight percentage, floored
+   * \param right the right percentage, floored
+   * \return the distribution of the next turn
+   */
+  static TurnAlias GetAlias (uint32_t straight, uint32_t right);
+
+  std::vector<TurnAlias> m_tables; //!< distributions, by straight and right percentages
+  uint32_t m_users; //!< number of vehicles drawing from the pool
+};
+
+} // namespace ns3
+
+#endif /* TURN_POOL_H */
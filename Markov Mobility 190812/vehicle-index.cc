@@ -0,0 +1,344 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "vehicle-index.h"
+#include "ns3/pointer.h"
+#include "ns3/nstime.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <cmath>
+#include <limits>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("VehicleIndex");
+
+NS_OBJECT_ENSURE_REGISTERED (VehicleIndex);
+
+TypeId
+VehicleIndex::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::VehicleIndex")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<VehicleIndex> ()
+    .AddAttribute ("RoadGrid", "The road layout whose blocks are the cells of the index.",
+                   PointerValue (),
+                   MakePointerAccessor (&VehicleIndex::SetRoadGrid,
+                                        &VehicleIndex::GetRoadGrid),
+                   MakePointerChecker<RoadGrid> ())
+  ;
+  return tid;
+}
+
+VehicleIndex::VehicleIndex ()
+  : m_n (0),
+    m_distance (0)
+{
+}
+
+VehicleIndex::~VehicleIndex ()
+{
+}
+
+void
+VehicleIndex::DoDispose (void)
+{
+  for (uint32_t i = 0; i < m_models.size (); i++)
+    {
+      m_models[i]->TraceDisconnectWithoutContext ("CourseChange", m_sinks[i]);
+    }
+  m_models.clear ();
+  m_sinks.clear ();
+  m_roadGrid = 0;
+  Object::DoDispose ();
+}
+
+void
+VehicleIndex::SetRoadGrid (Ptr<RoadGrid> roadGrid)
+{
+  NS_ABORT_MSG_IF (!m_vehicles.empty (), "VehicleIndex: the road layout cannot change once vehicles are tracked");
+  m_roadGrid = roadGrid;
+  if (m_roadGrid != 0)
+    {
+      m_n = m_roadGrid->GetIntersection ();
+      m_distance = m_roadGrid->GetDistance ();
+      m_cells.assign (m_n * m_n, std::vector<uint32_t> ());
+    }
+}
+
+Ptr<RoadGrid>
+VehicleIndex::GetRoadGrid (void) const
+{
+  return m_roadGrid;
+}
+
+uint32_t
+VehicleIndex::Add (Ptr<MobilityModel> model)
+{
+  NS_LOG_FUNCTION (this << model);
+  NS_ABORT_MSG_IF (m_roadGrid == 0, "VehicleIndex: no RoadGrid set");
+  // a throttled model moves on between its notifications
+  TimeValue interval;
+  NS_ABORT_MSG_IF (model->GetAttributeFailSafe ("MinCourseChangeInterval", interval)
+                   && interval.Get ().IsStrictlyPositive (),
+                   "VehicleIndex: the MinCourseChangeInterval of the model hides course changes");
+  uint32_t i = m_vehicles.size ();
+  Vehicle v;
+  v.x = 0;
+  v.y = 0;
+  v.vx = 0;
+  v.vy = 0;
+  v.t = 0;
+  v.next = std::numeric_limits<double>::infinity ();
+  v.cellX = 0;
+  v.cellY = 0;
+  v.slot = m_cells[0].size ();
+  v.version = 0;
+  m_vehicles.push_back (v);
+  m_cells[0].push_back (i);
+  m_models.push_back (model);
+  m_sinks.push_back (MakeBoundCallback (&VehicleIndex::CourseChanged, this, i));
+  model->TraceConnectWithoutContext ("CourseChange", m_sinks[i]);
+  Update (i);
+  return i;
+}
+
+uint32_t
+VehicleIndex::GetN (void) const
+{
+  return m_vehicles.size ();
+}
+
+Ptr<MobilityModel>
+VehicleIndex::Get (uint32_t i) const
+{
+  return m_models[i];
+}
+
+void
+VehicleIndex::CourseChanged (VehicleIndex *index, uint32_t i, Ptr<const MobilityModel>)
+{
+  index->Update (i);
+}
+
+void
+VehicleIndex::Update (uint32_t i)
+{
+  Vehicle &v = m_vehicles[i];
+  Vector position = m_models[i]->GetPosition ();
+  Vector velocity = m_models[i]->GetVelocity ();
+  v.x = position.x;
+  v.y = position.y;
+  v.vx = velocity.x;
+  v.vy = velocity.y;
+  v.t = Simulator::Now ().GetSeconds ();
+  uint32_t cellX = GetCell (v.x);
+  uint32_t cellY = GetCell (v.y);
+  if (cellX != v.cellX || cellY != v.cellY)
+    {
+      Move (i, cellX, cellY);
+    }
+  Schedule (i);
+}
+
+void
+VehicleIndex::Schedule (uint32_t i)
+{
+  Vehicle &v = m_vehicles[i];
+  bool alongX;
+  double next = GetCrossingTime (v, alongX);
+  if (next >= v.next)
+    {
+      // the queued crossing comes first and is checked again when it is due
+      return;
+    }
+  v.next = next;
+  v.version++;
+  m_crossings.push (Crossing { next, i, v.version });
+
+  if (m_crossings.size () > 2 * m_vehicles.size () + 64)
+    {
+      // drop the crossings queued before a later course change
+      std::vector<Crossing> live;
+      for (uint32_t j = 0; j < m_vehicles.size (); j++)
+        {
+          if (m_vehicles[j].next != std::numeric_limits<double>::infinity ())
+            {
+              live.push_back (Crossing { m_vehicles[j].next, j, m_vehicles[j].version });
+            }
+        }
+      m_crossings = std::priority_queue<Crossing, std::vector<Crossing>, std::greater<Crossing> >
+          (std::greater<Crossing> (), live);
+    }
+}
+
+double
+VehicleIndex::GetCrossingTime (const Vehicle &v, bool &alongX) const
+{
+  double inf = std::numeric_limits<double>::infinity ();
+  double tx = inf;
+  double ty = inf;
+  // the cells on the border of the lattice extend beyond it
+  if (v.vx > 0 && v.cellX + 1 < m_n)
+    {
+      tx = ((v.cellX + 1) * m_distance - v.x) / v.vx;
+    }
+  else if (v.vx < 0 && v.cellX > 0)
+    {
+      tx = (v.cellX * m_distance - v.x) / v.vx;
+    }
+  if (v.vy > 0 && v.cellY + 1 < m_n)
+    {
+      ty = ((v.cellY + 1) * m_distance - v.y) / v.vy;
+    }
+  else if (v.vy < 0 && v.cellY > 0)
+    {
+      ty = (v.cellY * m_distance - v.y) / v.vy;
+    }
+  alongX = tx <= ty;
+  return v.t + std::min (tx, ty);
+}
+
+void
+VehicleIndex::Refresh (double now)
+{
+  while (!m_crossings.empty () && m_crossings.top ().time <= now)
+    {
+      Crossing c = m_crossings.top ();
+      m_crossings.pop ();
+      Vehicle &v = m_vehicles[c.vehicle];
+      if (c.version != v.version)
+        {
+          continue;
+        }
+      // the vehicle may have slowed down since this crossing was queued
+      bool alongX;
+      double next = GetCrossingTime (v, alongX);
+      uint32_t cellX = v.cellX;
+      uint32_t cellY = v.cellY;
+      while (next <= now)
+        {
+          if (alongX)
+            {
+              cellX = v.vx > 0 ? cellX + 1 : cellX - 1;
+            }
+          else
+            {
+              cellY = v.vy > 0 ? cellY + 1 : cellY - 1;
+            }
+          Vehicle w = v;
+          w.cellX = cellX;
+          w.cellY = cellY;
+          next = GetCrossingTime (w, alongX);
+        }
+      if (cellX != v.cellX || cellY != v.cellY)
+        {
+          Move (c.vehicle, cellX, cellY);
+        }
+      v.next = next;
+      if (next != std::numeric_limits<double>::infinity ())
+        {
+          m_crossings.push (Crossing { next, c.vehicle, v.version });
+        }
+    }
+}
+
+uint32_t
+VehicleIndex::GetCell (double a) const
+{
+  double offset;
+  int64_t block = m_roadGrid->GetBlock (a, offset);
+  if (block < 0)
+    {
+      return 0;
+    }
+  return std::min ((uint32_t) block, m_n - 1);
+}
+
+void
+VehicleIndex::Move (uint32_t i, uint32_t cellX, uint32_t cellY)
+{
+  Vehicle &v = m_vehicles[i];
+  std::vector<uint32_t> &from = m_cells[v.cellY * m_n + v.cellX];
+  // swap with the last vehicle of the cell
+  from[v.slot] = from.back ();
+  m_vehicles[from[v.slot]].slot = v.slot;
+  from.pop_back ();
+  std::vector<uint32_t> &to = m_cells[cellY * m_n + cellX];
+  v.cellX = cellX;
+  v.cellY = cellY;
+  v.slot = to.size ();
+  to.push_back (i);
+}
+
+void
+VehicleIndex::GetInRadius (const Vector &centre, double radius, std::vector<uint32_t> &vehicles)
+{
+  double now = Simulator::Now ().GetSeconds ();
+  Refresh (now);
+  vehicles.clear ();
+  Rectangle rectangle (centre.x - radius, centre.x + radius, centre.y - radius, centre.y + radius);
+  Collect (rectangle, now, vehicles, centre, radius);
+}
+
+void
+VehicleIndex::GetInRectangle (const Rectangle &rectangle, std::vector<uint32_t> &vehicles)
+{
+  double now = Simulator::Now ().GetSeconds ();
+  Refresh (now);
+  vehicles.clear ();
+  Collect (rectangle, now, vehicles, Vector (), -1);
+}
+
+void
+VehicleIndex::Collect (const Rectangle &rectangle, double now, std::vector<uint32_t> &vehicles,
+                       const Vector &centre, double radius) const
+{
+  uint32_t x0 = GetCell (rectangle.xMin);
+  uint32_t x1 = GetCell (rectangle.xMax);
+  uint32_t y0 = GetCell (rectangle.yMin);
+  uint32_t y1 = GetCell (rectangle.yMax);
+  double r2 = radius * radius;
+  for (uint32_t cy = y0; cy <= y1; cy++)
+    {
+      for (uint32_t cx = x0; cx <= x1; cx++)
+        {
+          const std::vector<uint32_t> &cell = m_cells[cy * m_n + cx];
+          for (std::vector<uint32_t>::const_iterator it = cell.begin (); it != cell.end (); ++it)
+            {
+              const Vehicle &v = m_vehicles[*it];
+              double x = v.x + v.vx * (now - v.t);
+              double y = v.y + v.vy * (now - v.t);
+              bool inside;
+              if (radius < 0)
+                {
+                  inside = rectangle.IsInside (Vector (x, y, 0));
+                }
+              else
+                {
+                  inside = (x - centre.x) * (x - centre.x) + (y - centre.y) * (y - centre.y) <= r2;
+                }
+              if (inside)
+                {
+                  vehicles.push_back (*it);
+                }
+            }
+        }
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,198 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef VEHICLE_INDEX_H
+#define VEHICLE_INDEX_H
+
+#include "ns3/object.h"
+#include "ns3/ptr.h"
+#include "ns3/callback.h"
+#include "ns3/rectangle.h"
+#include "ns3/vector.h"
+#include "mobility-model.h"
+#include "road-grid.h"
+#include <vector>
+#include <queue>
+#include <functional>
+
+namespace ns3 {
+
+/**
+ * \ingroup mobility
+ * \brief Spatial hash of vehicles, one cell per block of a RoadGrid.
+ *
+ * The index follows each vehicle through its CourseChange trace and
+ * keeps the position and velocity of its last course change. Between
+ * two course changes a vehicle moves in a straight line, so the index
+ * works out itself when it leaves its cell: the crossings are kept in a
+ * queue ordered by time and applied by the next query that comes after
+ * them. A query only looks at the cells overlapping the searched area.
+ *
+ * Works with Intersections and IntersectionsFleetMobilityModel. The
+ * index is only right if every change of velocity is notified, so Add
+ * refuses a model whose MinCourseChangeInterval throttles its
+ * notifications. CoalesceCourseChange on Intersections is fine: it still
+ * notifies every change of speed, on every step with a random Speed, and
+ * only drops the steps on which the velocity stays the same.
+ */
+class VehicleIndex : public Object
+{
+public:
+  /**
+   * Register this type with the TypeId system.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  VehicleIndex ();
+  virtual ~VehicleIndex ();
+
+  /**
+   * \param roadGrid the road layout whose blocks are the cells of the index
+   */
+  void SetRoadGrid (Ptr<RoadGrid> roadGrid);
+  /**
+   * \return the road layout
+   */
+  Ptr<RoadGrid> GetRoadGrid (void) const;
+
+  /**
+   * \brief Start tracking a vehicle
+   *
+   * Aborts if the model has a MinCourseChangeInterval above zero.
+   *
+   * \param model the mobility model of the vehicle
+   * \return the index of the vehicle
+   */
+  uint32_t Add (Ptr<MobilityModel> model);
+  /**
+   * \return the number of vehicles tracked
+   */
+  uint32_t GetN (void) const;
+  /**
+   * \param i the index of a vehicle
+   * \return its mobility model
+   */
+  Ptr<MobilityModel> Get (uint32_t i) const;
+  /**
+   * \brief Read again the position and velocity of a vehicle
+   *
+   * Called on every course change of the vehicle.
+   *
+   * \param i the index of a vehicle
+   */
+  void Update (uint32_t i);
+
+  /**
+   * \param centre the centre of the searched disc
+   * \param radius the radius of the searched disc
+   * \param vehicles cleared, then filled with the indices of the vehicles inside the disc
+   */
+  void GetInRadius (const Vector &centre, double radius, std::vector<uint32_t> &vehicles);
+  /**
+   * \param rectangle the searched area
+   * \param vehicles cleared, then filled with the indices of the vehicles inside the area
+   */
+  void GetInRectangle (const Rectangle &rectangle, std::vector<uint32_t> &vehicles);
+
+private:
+  virtual void DoDispose (void);
+
+  /** Motion of a vehicle since its last course change. */
+  struct Vehicle
+  {
+    double x;           //!< x coordinate at time t
+    double y;           //!< y coordinate at time t
+    double vx;          //!< velocity along x
+    double vy;          //!< velocity along y
+    double t;           //!< time of the last course change, in seconds
+    double next;        //!< time of the queued cell crossing
+    uint32_t cellX;     //!< column of the cell
+    uint32_t cellY;     //!< row of the cell
+    uint32_t slot;      //!< position in the list of the cell
+    uint32_t version;   //!< bumped each time a crossing is queued
+  };
+
+  /** A queued cell crossing. */
+  struct Crossing
+  {
+    double time;        //!< time of the crossing, in seconds
+    uint32_t vehicle;   //!< index of the vehicle
+    uint32_t version;   //!< version of the vehicle when queued
+    bool operator > (const Crossing &o) const
+    {
+      return time > o.time;
+    }
+  };
+
+  /**
+   * Trace sink of the CourseChange of the tracked models; the model
+   * passed by the trace is the one kept at index i.
+   * \param index the index
+   * \param i the index of the vehicle
+   */
+  static void CourseChanged (VehicleIndex *index, uint32_t i, Ptr<const MobilityModel>);
+
+  /**
+   * Apply the cell crossings up to now.
+   * \param now the current time, in seconds
+   */
+  void Refresh (double now);
+  /**
+   * \param v a vehicle
+   * \param alongX set to true if the next crossing is across a vertical edge
+   * \return the time at which the vehicle leaves its cell, or infinity
+   */
+  double GetCrossingTime (const Vehicle &v, bool &alongX) const;
+  /**
+   * \param a a coordinate
+   * \return the row or column of the cell holding it, clamped to the lattice
+   */
+  uint32_t GetCell (double a) const;
+  /**
+   * Move a vehicle to another cell.
+   * \param i the index of the vehicle
+   * \param cellX the new column
+   * \param cellY the new row
+   */
+  void Move (uint32_t i, uint32_t cellX, uint32_t cellY);
+  /**
+   * Queue the next crossing of a vehicle if it comes sooner than the queued one.
+   * \param i the index of the vehicle
+   */
+  void Schedule (uint32_t i);
+  /**
+   * Collect the vehicles of the cells overlapping a rectangle.
+   * \param rectangle the searched area
+   * \param now the current time, in seconds
+   * \param vehicles filled with the indices of the vehicles inside the area
+   * \param centre the centre of the searched disc, if radius is not negative
+   * \param radius the radius of the searched disc, or negative for the whole rectangle
+   */
+  void Collect (const Rectangle &rectangle, double now, std::vector<uint32_t> &vehicles,
+                const Vector &centre, double radius) const;
+
+  Ptr<RoadGrid> m_roadGrid; //!< road layout
+  uint32_t m_n; //!< cells on each axis
+  double m_distance; //!< size of a cell
+  std::vector<Vehicle> m_vehicles; //!< tracked vehicles
+  std::vector<Ptr<MobilityModel> > m_models; //!< their models
+  std::vector<Callback<void, Ptr<const MobilityModel> > > m_sinks; //!< their CourseChange sinks
+  std::vector<std::vector<uint32_t> > m_cells; //!< vehicles of each cell, row after row
+  std::priority_queue<Crossing, std::vector<Crossing>, std::greater<Crossing> > m_crossings; //!< queued cell crossings
+};
+
+} // namespace ns3
+
+#endif /* VEHICLE_INDEX_H */